@@ -0,0 +1,103 @@
+#include "batch.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include "bufferpool.h"
+#include "filter.h"
+#include "threadpool.h"
+#include "trace.h"
+
+// Images decoded but not yet written, per thread that can work on them
+constexpr int BATCH_IMAGES_PER_THREAD = 2;
+
+bool decodeImage(const QString &file, BufferPool &pool, Image &image) {
+    TRACE_SCOPE("batchDecode");
+    QImage source;
+    if (!source.load(file)) {
+        return false;
+    }
+    source = source.convertToFormat(QImage::Format_RGBX8888);
+    image.width = source.width();
+    image.height = source.height();
+    image.data = pool.take(size_t(image.width) * image.height);
+    for (int y = 0; y < image.height; y++) {
+        std::memcpy(&image.data[size_t(y) * image.width], source.constScanLine(y), size_t(image.width) * sizeof(RGBA));
+    }
+    return true;
+}
+
+bool encodeImage(const Image &image, const QString &file) {
+    TRACE_SCOPE("batchEncode");
+    QImage result((const uchar*)image.data.data(), image.width, image.height, QImage::Format_RGBX8888);
+    return result.save(file);
+}
+
+// Decodes, filters and encodes one image; runs as a pool task
+static bool processImage(const QString &file, const QString &outputDir, const Settings &params, BufferPool &pool) {
+    TRACE_SCOPE("batchImage");
+    Image image;
+    if (!decodeImage(file, pool, image)) {
+        std::cout << "Failed to load " << file.toStdString() << std::endl;
+        return false;
+    }
+
+    FilterProgress progress;
+    applyFilter(image, params, pool, progress);
+
+    QString output = QDir(outputDir).filePath(QFileInfo(file).fileName());
+    bool written = encodeImage(image, output);
+    if (!written) {
+        std::cout << "Failed to save " << output.toStdString() << std::endl;
+    }
+    pool.give(std::move(image.data));
+    return written;
+}
+
+BatchStats runBatchFilter(const QStringList &inputs, const QString &outputDir, const Settings &params) {
+    TRACE_SCOPE("runBatchFilter");
+    ThreadPool &threads = ThreadPool::instance();
+    BufferPool pool;
+    BatchStats stats;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    int inFlight = 0;
+    int maxInFlight = BATCH_IMAGES_PER_THREAD * threads.concurrency();
+
+    auto start = std::chrono::steady_clock::now();
+    std::int64_t idleStart = threads.idleNs();
+
+    for (const QString &file : inputs) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return inFlight < maxInFlight; });
+            inFlight++;
+        }
+        threads.submit([&, file] {
+            bool written = processImage(file, outputDir, params, pool);
+            std::lock_guard<std::mutex> lock(mutex);
+            (written ? stats.images : stats.failed)++;
+            inFlight--;
+            finished.notify_all();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return inFlight == 0; });
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (stats.seconds > 0.0) {
+        stats.imagesPerSecond = stats.images / stats.seconds;
+        double workerSeconds = stats.seconds * std::max(1, threads.workerCount());
+        double idleSeconds = (threads.idleNs() - idleStart) * 1e-9;
+        stats.utilization = std::clamp(1.0 - idleSeconds / workerSeconds, 0.0, 1.0);
+    }
+    return stats;
+}
@@ -0,0 +1,38 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QString>
+#include <QStringList>
+#include "bufferpool.h"
+#include "filter.h"
+#include "settings.h"
+
+/**
+ * Headless batch filtering.
+ *
+ * Every image is one task on the shared ThreadPool that decodes, filters and
+ * encodes it, and a bounded number of images are in flight at once, so the
+ * decode, filter and encode stages of different images overlap. Inside the
+ * filter, each image is split into FILTER_STRIP_ROWS-high strips that go on
+ * the running worker's deque; workers that run out of images steal strips of
+ * the large ones, so neither a few huge images nor many tiny ones leave cores
+ * idle.
+ */
+
+struct BatchStats {
+    int images = 0;             // written successfully
+    int failed = 0;             // could not be read or written
+    double seconds = 0.0;
+    double imagesPerSecond = 0.0;
+    double utilization = 0.0;   // fraction of pool worker time spent working
+};
+
+// Reads file into image, taking the pixel buffer from pool
+bool decodeImage(const QString &file, BufferPool &pool, Image &image);
+bool encodeImage(const Image &image, const QString &file);
+
+// Filters every image in inputs with params and writes the results to
+// outputDir under their original file names
+BatchStats runBatchFilter(const QStringList &inputs, const QString &outputDir, const Settings &params);
+
+#endif // BATCH_H
@@ -0,0 +1,148 @@
+#include "blend.h"
+#include <cstring>
+#include "srgb.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BLEND_SSE2 1
+#endif
+
+// x / 255 rounded to nearest, for the 16-bit linear products
+static inline std::uint32_t div255Wide(std::uint32_t x) {
+    return (x + 127) / 255;
+}
+
+// blendPixel in linear light, with the color already decoded
+static RGBA blendPixelLinear(const SrgbTables &tables, const RGBA &base, const RGBA &color,
+                             const LinearPixel &linearColor, std::uint8_t coverage, BlendMode mode) {
+    std::uint32_t a = div255(coverage * color.a);
+    if (a == 0) {
+        return base;
+    }
+    if (a == 255) {
+        // the color replaces the base, whose alpha BLEND_MIX keeps
+        return RGBA{color.r, color.g, color.b, mode == BLEND_MIX ? base.a : std::uint8_t(255)};
+    }
+    std::uint32_t inverse = 255 - a;
+
+    if (mode == BLEND_MIX || base.a == 255) {
+        auto channel = [&](std::uint8_t baseValue, std::uint16_t colorValue) {
+            return linearToSrgb(tables, div255Wide(srgbToLinear(tables, baseValue) * inverse + colorValue * a));
+        };
+        return RGBA{channel(base.r, linearColor.r), channel(base.g, linearColor.g), channel(base.b, linearColor.b),
+                    mode == BLEND_MIX ? base.a : std::uint8_t(255)};
+    }
+
+    std::uint32_t baseWeight = base.a * inverse;
+    std::uint32_t outAlpha = a + div255(baseWeight);
+    std::uint64_t denominator = a * 255 + baseWeight;
+    auto channel = [&](std::uint8_t baseValue, std::uint16_t colorValue) {
+        std::uint64_t weighted = std::uint64_t(colorValue) * a * 255 + std::uint64_t(srgbToLinear(tables, baseValue)) * baseWeight;
+        return linearToSrgb(tables, static_cast<std::uint16_t>((weighted + denominator / 2) / denominator));
+    };
+    return RGBA{channel(base.r, linearColor.r), channel(base.g, linearColor.g), channel(base.b, linearColor.b),
+                static_cast<std::uint8_t>(outAlpha)};
+}
+
+static LinearPixel decodeColor(const SrgbTables &tables, const RGBA &color) {
+    return LinearPixel{srgbToLinear(tables, color.r), srgbToLinear(tables, color.g), srgbToLinear(tables, color.b), 0};
+}
+
+RGBA blendPixel(const RGBA &base, const RGBA &color, std::uint8_t coverage, BlendMode mode, bool linearLight) {
+    if (linearLight) {
+        const SrgbTables &tables = srgbTables();
+        return blendPixelLinear(tables, base, color, decodeColor(tables, color), coverage, mode);
+    }
+
+    std::uint32_t a = div255(coverage * color.a);
+    if (a == 0) {
+        return base;
+    }
+    std::uint32_t inverse = 255 - a;
+
+    if (mode == BLEND_MIX || base.a == 255) {
+        return RGBA{static_cast<std::uint8_t>(div255(base.r * inverse + color.r * a)),
+                    static_cast<std::uint8_t>(div255(base.g * inverse + color.g * a)),
+                    static_cast<std::uint8_t>(div255(base.b * inverse + color.b * a)),
+                    mode == BLEND_MIX ? base.a : std::uint8_t(255)};
+    }
+
+    // over a translucent base: premultiply both, add, then unpremultiply
+    std::uint32_t baseWeight = base.a * inverse;  // base alpha * (1 - a), in units of 255^2
+    std::uint32_t outAlpha = a + div255(baseWeight);
+    std::uint32_t denominator = a * 255 + baseWeight;
+    auto channel = [&](std::uint32_t baseValue, std::uint32_t colorValue) {
+        return static_cast<std::uint8_t>((colorValue * a * 255 + baseValue * baseWeight + denominator / 2) / denominator);
+    };
+    return RGBA{channel(base.r, color.r), channel(base.g, color.g), channel(base.b, color.b),
+                static_cast<std::uint8_t>(outAlpha)};
+}
+
+#ifdef BLEND_SSE2
+// div255 on eight 16-bit lanes
+static inline __m128i div255x8(__m128i x) {
+    __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Blends two pixels held as eight 16-bit channels, given each channel's opacity
+static inline __m128i mixTwo(__m128i base, __m128i color, __m128i alpha) {
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    return div255x8(_mm_add_epi16(_mm_mullo_epi16(base, inverse), _mm_mullo_epi16(color, alpha)));
+}
+#endif
+
+void blendSpan(RGBA *out, const RGBA *base, const std::uint8_t *coverage, const RGBA &color, int count, BlendMode mode,
+               bool linearLight) {
+    if (linearLight) {
+        const SrgbTables &tables = srgbTables();
+        LinearPixel linearColor = decodeColor(tables, color);
+        for (int i = 0; i < count; i++) {
+            out[i] = blendPixelLinear(tables, base[i], color, linearColor, coverage[i], mode);
+        }
+        return;
+    }
+
+    int i = 0;
+
+#ifdef BLEND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i colorA = _mm_set1_epi16(color.a);
+    std::uint32_t colorBits;
+    std::memcpy(&colorBits, &color, 4);
+    const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(colorBits)), zero);
+    const __m128i alphaBytes = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + i));
+        // BLEND_OVER only stays in 8-bit lanes over an opaque base
+        if (mode == BLEND_OVER &&
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(pixels, alphaBytes), alphaBytes)) != 0xFFFF) {
+            for (int k = 0; k < 4; k++) {
+                out[i + k] = blendPixel(base[i + k], color, coverage[i + k], mode);
+            }
+            continue;
+        }
+
+        // spread each pixel's coverage over its four channels, then scale by color alpha
+        std::uint32_t coverageBits;
+        std::memcpy(&coverageBits, coverage + i, 4);
+        __m128i coverage16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(coverageBits)), zero);
+        coverage16 = _mm_unpacklo_epi16(coverage16, coverage16);
+        __m128i alphaLow = div255x8(_mm_mullo_epi16(_mm_unpacklo_epi32(coverage16, coverage16), colorA));
+        __m128i alphaHigh = div255x8(_mm_mullo_epi16(_mm_unpackhi_epi32(coverage16, coverage16), colorA));
+
+        __m128i low = mixTwo(_mm_unpacklo_epi8(pixels, zero), color16, alphaLow);
+        __m128i high = mixTwo(_mm_unpackhi_epi8(pixels, zero), color16, alphaHigh);
+        __m128i blended = _mm_packus_epi16(low, high);
+
+        // both modes keep the base alpha here (it is 255 under BLEND_OVER)
+        blended = _mm_or_si128(_mm_andnot_si128(alphaBytes, blended), _mm_and_si128(alphaBytes, pixels));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), blended);
+    }
+#endif
+
+    for (; i < count; i++) {
+        out[i] = blendPixel(base[i], color, coverage[i], mode);
+    }
+}
@@ -0,0 +1,74 @@
+#include "bufferpool.h"
+#include <bit>
+#include <utility>
+
+// Rounds pixels up to the next size class: 1, 1.25, 1.5 or 1.75 times a power of two
+static std::size_t classCapacity(std::size_t pixels) {
+    if (pixels <= 4) {
+        return 4;
+    }
+    std::size_t step = std::bit_floor(pixels) / 4;
+    return (pixels + step - 1) / step * step;
+}
+
+/**
+ * @brief Hands out the smallest pooled buffer that holds pixels, within twice
+ * the request's class, found by a scan over the few slots
+ */
+std::vector<RGBA> BufferPool::take(std::size_t pixels) {
+    std::size_t capacity = classCapacity(pixels);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<RGBA> *best = nullptr;
+        for (std::vector<RGBA> &slot : m_free) {
+            std::size_t slotCapacity = slot.capacity();
+            if (slotCapacity >= pixels && slotCapacity <= 2 * capacity &&
+                (!best || slotCapacity < best->capacity())) {
+                best = &slot;
+            }
+        }
+        if (best) {
+            std::vector<RGBA> buffer = std::exchange(*best, {});
+            buffer.resize(pixels);
+            return buffer;
+        }
+        m_misses++;
+    }
+
+    std::vector<RGBA> buffer;
+    buffer.reserve(capacity);
+    buffer.resize(pixels);
+    return buffer;
+}
+
+void BufferPool::give(std::vector<RGBA> &&buffer) {
+    if (buffer.capacity() == 0) {
+        return;
+    }
+    // freed after the lock is released
+    std::vector<RGBA> evicted;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // a free slot, else the smallest buffer; it is the cheapest to allocate again
+    std::vector<RGBA> *target = &m_free[0];
+    for (std::vector<RGBA> &slot : m_free) {
+        if (slot.capacity() < target->capacity()) {
+            target = &slot;
+        }
+    }
+    if (target->capacity() > buffer.capacity()) {
+        evicted = std::move(buffer);
+        return;
+    }
+    evicted = std::exchange(*target, std::move(buffer));
+}
+
+void BufferPool::trim() {
+    std::array<std::vector<RGBA>, MAX_POOLED_BUFFERS> freed;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    freed.swap(m_free);
+}
+
+std::size_t BufferPool::misses() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
@@ -0,0 +1,67 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @class BufferPool
+ *
+ * Recycles full-size pixel buffers between filter passes and filter calls, so
+ * that steady-state filtering does no heap allocation and touches no fresh
+ * pages. Buffers are allocated with capacities rounded up to a size class
+ * (quarter steps between powers of two) and handed back out for any request
+ * that fits within twice the request's class.
+ *
+ * Thread-safe; the canvas owns one and shares it with its filter jobs.
+ */
+class BufferPool {
+public:
+    /**
+     * @brief A buffer borrowed from the pool, returned when the lease ends
+     */
+    class Lease {
+    public:
+        Lease(BufferPool &pool, std::vector<RGBA> &&buffer) : m_pool(&pool), m_buffer(std::move(buffer)) {}
+        Lease(Lease &&other) noexcept : m_pool(other.m_pool), m_buffer(std::move(other.m_buffer)) { other.m_pool = nullptr; }
+        ~Lease() { if (m_pool) m_pool->give(std::move(m_buffer)); }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease &operator=(Lease &&) = delete;
+
+        std::vector<RGBA> &operator*() { return m_buffer; }
+        std::vector<RGBA> *operator->() { return &m_buffer; }
+
+    private:
+        BufferPool *m_pool;
+        std::vector<RGBA> m_buffer;
+    };
+
+    // A buffer of exactly `pixels` elements with unspecified contents
+    std::vector<RGBA> take(std::size_t pixels);
+    Lease acquire(std::size_t pixels) { return Lease(*this, take(pixels)); }
+
+    // Returns a buffer (from take() or anywhere else) to the pool
+    void give(std::vector<RGBA> &&buffer);
+
+    // Frees every pooled buffer
+    void trim();
+
+    // Number of buffers the pool had to allocate because none fit
+    std::size_t misses() const;
+
+private:
+    static constexpr std::size_t MAX_POOLED_BUFFERS = 12;
+
+    mutable std::mutex m_mutex;
+    // pooled buffers in no particular order; a slot with no capacity is free.
+    // Fixed, so that pooling and reusing a buffer allocates nothing itself.
+    std::array<std::vector<RGBA>, MAX_POOLED_BUFFERS> m_free;
+    std::size_t m_misses = 0;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,234 @@
+#include "canny.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "settings.h"
+#include "trace.h"
+
+// Thresholds on the sensitivity-scaled gradient magnitude
+constexpr float CANNY_HIGH_THRESHOLD = 100.0f;
+constexpr float CANNY_LOW_THRESHOLD = 40.0f;
+
+// tan(22.5 degrees), the boundary between the four direction bins
+constexpr float TAN_22_5 = 0.41421356f;
+
+enum EdgeClass : std::uint8_t {
+    EDGE_NONE,
+    EDGE_WEAK,
+    EDGE_STRONG
+};
+
+// Gradient directions, binned to the neighbour pair suppression compares with
+enum GradientDirection : std::uint8_t {
+    GRADIENT_HORIZONTAL,    // left and right
+    GRADIENT_DIAGONAL,      // up-left and down-right
+    GRADIENT_VERTICAL,      // up and down
+    GRADIENT_ANTIDIAGONAL   // up-right and down-left
+};
+
+// Sobel's [1 2 1] smoothing, normalized so that it fits a gray plane. The
+// gradient stage scales the difference back up by its sum.
+constexpr std::array<float, 3> SOBEL_SMOOTH_NORMALIZED = {0.25f, 0.5f, 0.25f};
+constexpr float SOBEL_SMOOTH_SUM = 4.0f;
+
+namespace {
+
+// The [-1 0 1] derivative of `line` (limit samples, `stride` apart) at i, with
+// the samples past either end read through border
+float derivativeAt(const std::uint8_t *line, std::size_t stride, int limit, int i, BorderMode border) {
+    if (i > 0 && i < limit - 1) {
+        return float(line[(i + 1) * stride]) - float(line[(i - 1) * stride]);
+    }
+    int before = borderIndex(i - 1, limit, border);
+    int after = borderIndex(i + 1, limit, border);
+    return (after < 0 ? 0.0f : float(line[after * stride])) - (before < 0 ? 0.0f : float(line[before * stride]));
+}
+
+// Root of i's tree, without path compression so that concurrent readers are safe
+int findRoot(const int *parent, int i) {
+    while (parent[i] != i) {
+        i = parent[i];
+    }
+    return i;
+}
+
+// Root of i's tree, halving the path on the way; only for a single writer
+int findCompress(int *parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Joins the trees of a and b under the smaller root
+void unite(int *parent, int a, int b) {
+    a = findCompress(parent, a);
+    b = findCompress(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+} // namespace
+
+void filterCanny(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                 const GrayImage *gray) {
+    TRACE_SCOPE("filterCanny");
+    int w = image.width;
+    int h = image.height;
+    size_t n = size_t(w) * h;
+    ConvolveOptions options = convolveOptions(params, FILTER_EDGE_DETECT);
+    BorderMode border = options.border;
+
+    // three gray planes, each reused once its stage is read for the last time,
+    // and two of four-byte values
+    static_assert(sizeof(RGBA) == sizeof(float) && sizeof(RGBA) == sizeof(int));
+    GrayImage converted;
+    if (!gray) {
+        converted = takeGray(pool, w, h);
+        toGray(image, converted, progress);
+        gray = &converted;
+    }
+    GrayImage pass1 = takeGray(pool, w, h);
+    GrayImage blurred = takeGray(pool, w, h);
+    BufferPool::Lease magnitudeLease = pool.acquire(n);
+    BufferPool::Lease parentLease = pool.acquire(n);
+    float *magnitude = reinterpret_cast<float *>(magnitudeLease->data());
+    int *parent = reinterpret_cast<int *>(parentLease->data());
+
+    // 1. the Gaussian blur
+    const Kernel &gaussian = cachedKernel(KERNEL_GAUSSIAN, CANNY_BLUR_RADIUS);
+    convolve1DHorizontalGray(gaussian, *gray, pass1, options, progress);
+    convolve1DVerticalGray(gaussian, pass1, blurred, options, progress);
+
+    // 2. Sobel's smoothing across each derivative: vertically for the x
+    // gradient, horizontally for the y one
+    GrayImage smoothedX = gray == &converted ? std::move(converted) : takeGray(pool, w, h);
+    GrayImage &smoothedY = pass1;
+    convolve1DVerticalGray(SOBEL_SMOOTH_NORMALIZED, blurred, smoothedX, options, progress);
+    convolve1DHorizontalGray(SOBEL_SMOOTH_NORMALIZED, blurred, smoothedY, options, progress);
+
+    // 3. the derivatives, their magnitude and quantized direction. The gray
+    // planes hold no negative values, so the derivative taps are a difference
+    // taken here rather than a pass of their own.
+    std::uint8_t *direction = blurred.data();
+    float sensitivity = params.edgeDetectSensitivity * SOBEL_SMOOTH_SUM;
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            for (int c = 0; c < w; c++) {
+                float gx = derivativeAt(smoothedX.data() + size_t(r) * w, 1, w, c, border);
+                float gy = derivativeAt(smoothedY.data() + c, w, h, r, border);
+
+                float ax = std::fabs(gx);
+                float ay = std::fabs(gy);
+                GradientDirection bin;
+                if (ay <= ax * TAN_22_5) {
+                    bin = GRADIENT_HORIZONTAL;
+                } else if (ax <= ay * TAN_22_5) {
+                    bin = GRADIENT_VERTICAL;
+                } else {
+                    // y grows downwards, so equal signs point down-right
+                    bin = (gx > 0) == (gy > 0) ? GRADIENT_DIAGONAL : GRADIENT_ANTIDIAGONAL;
+                }
+                size_t i = size_t(r) * w + c;
+                magnitude[i] = std::sqrt(gx * gx + gy * gy) * sensitivity;
+                direction[i] = bin;
+            }
+        }
+    });
+
+    // 4. non-maximum suppression across the edge, then double thresholding
+    constexpr int NEIGHBOUR_X[4] = {1, 1, 0, 1};
+    constexpr int NEIGHBOUR_Y[4] = {0, 1, 1, -1};
+    std::uint8_t *edges = smoothedX.data();
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        auto magnitudeAt = [&](int x, int y) {
+            return x < 0 || x >= w || y < 0 || y >= h ? 0.0f : magnitude[size_t(y) * w + x];
+        };
+        for (int r = rowBegin; r < rowEnd; r++) {
+            for (int c = 0; c < w; c++) {
+                size_t i = size_t(r) * w + c;
+                float m = magnitude[i];
+                int dx = NEIGHBOUR_X[direction[i]];
+                int dy = NEIGHBOUR_Y[direction[i]];
+                // >= on one side only, so a two pixel wide ridge keeps exactly one pixel
+                bool peak = m >= magnitudeAt(c + dx, r + dy) && m > magnitudeAt(c - dx, r - dy);
+                if (!peak || m < CANNY_LOW_THRESHOLD) {
+                    edges[i] = EDGE_NONE;
+                } else {
+                    edges[i] = m >= CANNY_HIGH_THRESHOLD ? EDGE_STRONG : EDGE_WEAK;
+                }
+            }
+        }
+    });
+
+    // 5. hysteresis. Every edge pixel starts as its own tree; strips only union
+    // pixels inside themselves, so they never touch the same tree. They also
+    // clear their rows of the strong component flags for the pass after next.
+    std::uint8_t *strongRoot = smoothedY.data();
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        std::fill(strongRoot + size_t(rowBegin) * w, strongRoot + size_t(rowEnd) * w, 0);
+        for (int r = rowBegin; r < rowEnd; r++) {
+            for (int c = 0; c < w; c++) {
+                int i = r * w + c;
+                parent[i] = i;
+                if (edges[i] == EDGE_NONE) {
+                    continue;
+                }
+                // the already visited half of the 8-neighbourhood
+                if (c > 0 && edges[i - 1] != EDGE_NONE) {
+                    unite(parent, i, i - 1);
+                }
+                if (r > rowBegin) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        if (c + dx >= 0 && c + dx < w && edges[i - w + dx] != EDGE_NONE) {
+                            unite(parent, i, i - w + dx);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // join components across the seams between strips
+    for (int r = FILTER_STRIP_ROWS; r < h && !progress.isCancelled(); r += FILTER_STRIP_ROWS) {
+        for (int c = 0; c < w; c++) {
+            int i = r * w + c;
+            if (edges[i] == EDGE_NONE) {
+                continue;
+            }
+            for (int dx = -1; dx <= 1; dx++) {
+                if (c + dx >= 0 && c + dx < w && edges[i - w + dx] != EDGE_NONE) {
+                    unite(parent, i, i - w + dx);
+                }
+            }
+        }
+    }
+
+    // flag every component with a strong pixel; racing stores all write 1
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        for (int i = rowBegin * w; i < rowEnd * w; i++) {
+            if (edges[i] == EDGE_STRONG) {
+                std::atomic_ref<std::uint8_t>(strongRoot[findRoot(parent, i)]).store(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        for (int i = rowBegin * w; i < rowEnd * w; i++) {
+            bool edge = edges[i] != EDGE_NONE &&
+                        std::atomic_ref<std::uint8_t>(strongRoot[findRoot(parent, i)]).load(std::memory_order_relaxed);
+            std::uint8_t value = edge ? 255 : 0;
+            image.data[i].r = value;
+            image.data[i].g = value;
+            image.data[i].b = value;
+        }
+    });
+
+    pool.give(std::move(pass1.storage));
+    pool.give(std::move(blurred.storage));
+    pool.give(std::move(smoothedX.storage));
+}
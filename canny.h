@@ -0,0 +1,47 @@
+#ifndef CANNY_H
+#define CANNY_H
+
+#include "filter.h"
+
+/**
+ * CANNY EDGE DETECTION
+ *
+ * A pipeline of strip-parallel stages over shared full-size planes, pooled
+ * like the Sobel filter's:
+ *
+ *   1. gray, then the Gaussian blur as two 1D gray passes
+ *   2. the smoothing half of Sobel, as two more 1D gray passes
+ *   3. signed Sobel gradients, their magnitude and quantized direction
+ *   4. non-maximum suppression along the gradient, then double thresholding
+ *      into strong and weak edge pixels
+ *   5. hysteresis: weak pixels survive only if connected to a strong one
+ *
+ * Each stage is one or more passes over strips, and each strip reads the rows
+ * of its neighbours' previous-stage output that fall within the stage's halo
+ * (the blur radius, or one row for Sobel and suppression); the barrier between
+ * passes is what makes those halo rows available. Pixels outside the image
+ * are read through the edge detection border mode.
+ *
+ * Hysteresis labels connected edge pixels with a union-find forest: strips
+ * union their own pixels in parallel, the seams between strips are joined
+ * serially, and a final parallel pass keeps the components with a strong pixel.
+ */
+
+// Gaussian smoothing before differentiation; radius 3 is a standard deviation of 1
+constexpr int CANNY_BLUR_RADIUS = 3;
+
+// Pixels around an output pixel the pipeline reads before hysteresis: the
+// smoothing, then a row each for Sobel and suppression
+constexpr int CANNY_HALO = CANNY_BLUR_RADIUS + 2;
+
+// Strips the Canny pipeline reports progress for, per strip of the image; one
+// fewer when it is given the gray image
+constexpr int CANNY_PASSES = 10;
+
+// Replaces image with white Canny edges on black, starting from gray, the
+// luminance of image, if given. The gradient magnitude is scaled by
+// edgeDetectSensitivity before thresholding, as in the Sobel filter.
+void filterCanny(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                 const GrayImage *gray = nullptr);
+
+#endif // CANNY_H
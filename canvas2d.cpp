@@ -2,25 +2,48 @@
 #include <QPainter>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <random>
 #include <queue>
 #include "settings.h"
+#include "blend.h"
+#include "filter.h"
+#include "trace.h"
 
 /**
  * @brief Initializes new 500x500 canvas
  */
 void Canvas2D::init() {
     setMouseTracking(true);
+
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(33);
+    connect(m_progressTimer, &QTimer::timeout, this, &Canvas2D::reportFilterProgress);
+
+    m_settingsWriter = std::make_unique<SettingsWriter>(settings);
+
     m_width = 500;
     m_height = 500;
     clearCanvas();
 }
 
+Canvas2D::~Canvas2D() {
+    cancelFilter();
+    if (m_filterThread.joinable()) {
+        m_filterThread.join();
+    }
+}
+
 /**
  * @brief Canvas2D::clearCanvas sets all canvas pixels to blank white
  */
 void Canvas2D::clearCanvas() {
+    cancelFilter();
     m_data.assign(m_width * m_height, RGBA{255, 255, 255, 255});
+    clearSelection();
+    markDataChanged();
     settings.imagePath = "";
     displayImage();
 }
@@ -33,12 +56,17 @@ void Canvas2D::clearCanvas() {
  * @return True if successfully loads image, False otherwise.
  */
 bool Canvas2D::loadImageFromFile(const QString &file) {
+    TRACE_SCOPE("loadImageFromFile");
+    cancelFilter();
     QImage myImage;
     if (!myImage.load(file)) {
         std::cout<<"Failed to load in image"<<std::endl;
         return false;
     }
     myImage = myImage.convertToFormat(QImage::Format_RGBX8888);
+    m_previewFactor = 0;
+    // buffers sized for the old image are unlikely to fit the new one
+    m_bufferPool.trim();
     m_width = myImage.width();
     m_height = myImage.height();
     QByteArray arr = QByteArray::fromRawData((const char*) myImage.bits(), myImage.sizeInBytes());
@@ -48,6 +76,8 @@ bool Canvas2D::loadImageFromFile(const QString &file) {
     for (int i = 0; i < arr.size() / 4; i++){
         m_data.push_back(RGBA{(std::uint8_t) arr[4*i], (std::uint8_t) arr[4*i+1], (std::uint8_t) arr[4*i+2], (std::uint8_t) arr[4*i+3]});
     }
+    clearSelection();
+    markDataChanged();
     displayImage();
     return true;
 }
@@ -58,6 +88,7 @@ bool Canvas2D::loadImageFromFile(const QString &file) {
  * @return True if successfully saves image, False otherwise.
  */
 bool Canvas2D::saveImageToFile(const QString &file) {
+    TRACE_SCOPE("saveImageToFile");
     QImage myImage = QImage(m_width, m_height, QImage::Format_RGBX8888);
     for (int i = 0; i < m_data.size(); i++){
         myImage.setPixelColor(i % m_width, i / m_width, QColor(m_data[i].r, m_data[i].g, m_data[i].b, m_data[i].a));
@@ -74,353 +105,377 @@ bool Canvas2D::saveImageToFile(const QString &file) {
  * @brief Get Canvas2D's image data and display this to the GUI
  */
 void Canvas2D::displayImage() {
-    QByteArray img(reinterpret_cast<const char *>(m_data.data()), 4 * m_data.size());
-    QImage now = QImage((const uchar*)img.data(), m_width, m_height, QImage::Format_RGBX8888);
-    setPixmap(QPixmap::fromImage(now));
-    setFixedSize(m_width, m_height);
+    if (m_headless) {
+        return;
+    }
+    TRACE_SCOPE("displayImage");
+    // the pixels themselves are drawn by paintEvent, and only where visible
+    updateDisplaySize();
     update();
+    m_previewShown = false;
 }
 
 /**
- * @brief Canvas2D::resize resizes canvas to new width and height
- * @param w
- * @param h
- */
-void Canvas2D::resize(int w, int h) {
-    m_width = w;
-    m_height = h;
-    m_data.resize(w * h);
-    displayImage();
-}
-
-/**
- * FILTER FUNCTIONALITY
+ * VIEW
  */
 
+constexpr float MIN_ZOOM = 1.0f / 64.0f;
+constexpr float MAX_ZOOM = 8.0f;
 
-// Ensures the value lies within [0, 255]
-inline std::uint8_t clamp(float x) {
-    if (x < 0.0f) return 0;
-    if (x > 255.0f) return 255;
-    return static_cast<uint8_t>(std::min(std::max(round(x), 0.0f), 255.0f));
+void Canvas2D::setZoom(float zoom) {
+    m_zoom = std::clamp(zoom, MIN_ZOOM, MAX_ZOOM);
+    updateDisplaySize();
+    update();
 }
 
-// Repeats the pixel on the edge of the image such that A,B,C,D looks like ...A,A,A,B,C,D,D,D...
-RGBA getPixelRepeated(std::vector<RGBA> &data, int width, int height, int x, int y) {
-    int newX = (x < 0) ? 0 : std::min(x, width  - 1);
-    int newY = (y < 0) ? 0 : std::min(y, height - 1);
-    return data[width * newY + newX];
+void Canvas2D::updateDisplaySize() {
+    setFixedSize(std::max(1, static_cast<int>(std::ceil(m_width * m_zoom))),
+                 std::max(1, static_cast<int>(std::ceil(m_height * m_zoom))));
 }
 
-// assumes the input kernel is square, and has an odd-numbered side length
-std::vector<RGBA> Canvas2D::convolve2D(std::vector<float> kernel) {
-    // initialize a vector, called `result`, to temporarily store your output image data
-    std::vector<RGBA> result(m_data.size(), RGBA{0, 0, 0, 255});
-
-    int kernelLen = sqrt(kernel.size());
-    int kernelOffset = kernelLen / 2;
-
-    for (int r = 0; r < m_height; r++) {
-        for (int c = 0; c < m_width; c++) {
-            size_t centerIndex = r * m_width + c;
-
-            // initialize redAcc, greenAcc, and blueAcc float variables
-            float redAcc = 0.0f;
-            float greenAcc = 0.0f;
-            float blueAcc = 0.0f;
-
-            // iterate over the kernel using its dimension
-            for (int kr = 0; kr < kernelLen; kr++) {
-                for (int kc = 0; kc < kernelLen; kc++) {
-                    int index = kr * kernelLen + kc;
-                    float weight = kernel[index];
-
-                    int offsetX = kc - kernelOffset;
-                    int offsetY = kr - kernelOffset;
-
-                    RGBA pixel = getPixelRepeated(m_data, m_width, m_height, c + offsetX, r + offsetY);
-
-                    redAcc += weight * pixel.r;
-                    greenAcc += weight * pixel.g;
-                    blueAcc += weight * pixel.b;
-                }
-            }
-
-            // update buffer with the new RGBA pixel value created from redAcc, greenAcc, and blueAcc
-            result[centerIndex].r = clamp(redAcc);
-            result[centerIndex].g = clamp(greenAcc);
-            result[centerIndex].b = clamp(blueAcc);
-        }
-    }
-
-    return result;
-}
-
-void Canvas2D::filterBlur() {
-    int r = settings.blurRadius;
-
-    if (r == 0) {
-        // identity filter
+/**
+ * @brief Draws the part of the canvas Qt asks for (the visible part of the
+ * scroll area) from the pyramid level that matches the zoom, without copying
+ * the pixels
+ */
+void Canvas2D::paintEvent(QPaintEvent *event) {
+    TRACE_SCOPE("paintCanvas");
+    QPainter painter(this);
+    if (m_previewShown) {
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        painter.drawImage(QRectF(0, 0, m_previewImage.width() * m_zoom, m_previewImage.height() * m_zoom), m_previewImage);
         return;
     }
 
-    float stddev = r / 3.0;
-    int kernelSize = 2 * r + 1;
-    std::vector<float> kernel(kernelSize); // initiate 1D kernel
-
-    double sum = 0.0;
-    for (int i = 0; i < kernelSize; i++) {
-        int dx = i - r;  // offset from the center
-        double value = (1 / (std::sqrt(2 * M_PI * pow(stddev, 2)))) *
-                       std::exp(-(pow(dx, 2) / (2 * pow(stddev, 2))));
-
-        kernel[i] = value;
-        sum += value;
+    if (m_view.levelWidth(0) != m_width || m_view.levelHeight(0) != m_height) {
+        m_view.reset(m_width, m_height);
     }
-
-    // normalize kernel
-    for (int i = 0; i < kernel.size(); i++) {
-        kernel[i] /= sum;
+    m_view.refresh(m_data);
+
+    int level = m_view.levelFor(m_zoom);
+    int levelWidth = m_view.levelWidth(level);
+    int levelHeight = m_view.levelHeight(level);
+    float scale = m_zoom * (1 << level);    // screen pixels per level pixel
+
+    // the level pixels under the exposed rectangle
+    QRect exposed = event->rect();
+    int x0 = std::clamp(static_cast<int>(std::floor(exposed.left() / scale)), 0, levelWidth);
+    int y0 = std::clamp(static_cast<int>(std::floor(exposed.top() / scale)), 0, levelHeight);
+    int x1 = std::clamp(static_cast<int>(std::ceil((exposed.right() + 1) / scale)), 0, levelWidth);
+    int y1 = std::clamp(static_cast<int>(std::ceil((exposed.bottom() + 1) / scale)), 0, levelHeight);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
     }
 
-    // horizontal pass
-    std::vector<RGBA> pass1Data = convolve1DHorizontal(kernel, m_data);
+    const RGBA *pixels = m_view.levelData(level, m_data) + size_t(y0) * levelWidth + x0;
+    QImage region((const uchar*)pixels, x1 - x0, y1 - y0, levelWidth * sizeof(RGBA), QImage::Format_RGBX8888);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1.0f);
+    painter.drawImage(QRectF(x0 * scale, y0 * scale, (x1 - x0) * scale, (y1 - y0) * scale), region);
 
-    // vertical pass
-    std::vector<RGBA> filteredData = convolve1DVertical(kernel, pass1Data);
+    if (!m_selection.empty()) {
+        const PixelRect &bounds = m_selection.bounds;
+        painter.setPen(Qt::DashLine);
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(QRectF(bounds.x0 * m_zoom, bounds.y0 * m_zoom, bounds.width() * m_zoom, bounds.height() * m_zoom));
+    }
+}
 
-    // copy the RGBA data from `filteredData` to `m_data`
-    for (size_t i = 0; i < m_data.size(); i++) {
-        m_data[i] = filteredData[i];
+void Canvas2D::wheelEvent(QWheelEvent *event) {
+    if (!(event->modifiers() & Qt::ControlModifier)) {
+        QLabel::wheelEvent(event);
+        return;
     }
+    setZoom(event->angleDelta().y() > 0 ? m_zoom * 1.25f : m_zoom / 1.25f);
+    event->accept();
 }
 
-std::uint8_t rgbaToGray(const RGBA &pixel) {
-    std::uint8_t grayValue = static_cast<std::uint8_t>(0.299 * pixel.r + 0.587 * pixel.g + 0.114 * pixel.b);
-    return clamp(grayValue);
+/**
+ * @brief Must be called after every change to m_data, so that anything derived
+ * from the canvas contents (e.g. the preview proxy) knows it is stale
+ */
+void Canvas2D::markDataChanged() {
+    m_dataVersion++;
+    m_view.markAllDirty();
 }
 
-void Canvas2D::filterGray() {
-    for (int row = 0; row < m_height; ++row) {
-        for (int col = 0; col < m_width; ++col) {
-            size_t currentIndex = m_width * row + col;
-            RGBA &currentPixel = m_data[currentIndex];
+// Same, for a change confined to [x0, x1) x [y0, y1)
+void Canvas2D::markDataChanged(int x0, int y0, int x1, int y1) {
+    m_dataVersion++;
+    m_view.markDirty(x0, y0, x1, y1);
+}
 
-            // call rgbaToGray()
-            std::uint8_t resultGray = rgbaToGray(currentPixel);
-            // update currentPixel's color
-            currentPixel.r = resultGray;
-            currentPixel.g = resultGray;
-            currentPixel.b = resultGray;
-        }
+/**
+ * @brief Histograms of the canvas, shared with filter jobs. Computed at most
+ * once per canvas version, however many filters or previews ask for them.
+ */
+std::shared_ptr<const ImageStats> Canvas2D::imageStats() {
+    if (!m_stats || m_statsVersion != m_dataVersion) {
+        m_stats = std::make_shared<const ImageStats>(computeImageStats(m_data.data(), m_data.size()));
+        m_statsVersion = m_dataVersion;
     }
+    return m_stats;
 }
 
-void Canvas2D::filterEdgeDetect() {
-    //convert image to grayscale
-    filterGray();
-
-    // separable sobel kernels
-    std::vector<float> sobelXHorizontal = {-1.0f, 0.0f, 1.0f};
-    std::vector<float> sobelXVertical = {1.0f, 2.0f, 1.0f};
-
-    std::vector<float> sobelYHorizontal = {1.0f, 2.0f, 1.0f};
-    std::vector<float> sobelYVertical = {-1.0f, 0.0f, 1.0f};
-
-    // compute gradient in x direction
-    std::vector<RGBA> G_xPass1 = convolve1DHorizontal(sobelXHorizontal, m_data);
-    std::vector<RGBA> G_x = convolve1DVertical(sobelXVertical, G_xPass1);
+std::uint64_t Canvas2D::contentHash() {
+    if (m_contentHashVersion != m_dataVersion) {
+        m_contentHash = hashPixels(m_data.data(), m_data.size());
+        m_contentHashVersion = m_dataVersion;
+    }
+    return m_contentHash;
+}
 
-    // compute gradient in y direction
-    std::vector<RGBA> G_yPass1 = convolve1DHorizontal(sobelYHorizontal, m_data);
-    std::vector<RGBA> G_y = convolve1DVertical(sobelYVertical, G_yPass1);
+/**
+ * @brief Canvas2D::resize resizes canvas to new width and height
+ * @param w
+ * @param h
+ */
+void Canvas2D::resize(int w, int h) {
+    cancelFilter();
+    m_width = w;
+    m_height = h;
+    m_data.resize(w * h);
+    clearSelection();
+    markDataChanged();
+    displayImage();
+}
 
-    // approximate magnitude of the gradient of image
-    for (size_t i = 0; i < m_data.size(); i++) {
-        float gradient_x = static_cast<float>(rgbaToGray(G_x[i]));
-        float gradient_y = static_cast<float>(rgbaToGray(G_y[i]));
+/**
+ * FILTER FUNCTIONALITY
+ */
 
-        float G_mag = std::sqrt(gradient_x * gradient_x + gradient_y * gradient_y);
-        G_mag *= settings.edgeDetectSensitivity; //multiply by sensitivity parameter
-        uint8_t clampedValue = clamp(G_mag);
+// A filter running on a snapshot of the canvas. The job thread owns `image`
+// until it finishes; the GUI thread only touches `progress` in the meantime.
+struct FilterJob {
+    Image image;
+    Settings params;
+    FilterProgress progress;
+    std::shared_ptr<const ImageStats> stats;    // set for filters that use them
+    // With a selection, image may be just the part of the canvas around it,
+    // whose top left corner is at (originX, originY)
+    FilterRegion region;
+    int originX = 0;
+    int originY = 0;
+    FilterCacheKey cacheKey;
+    bool cached = false;                        // image came from the cache
+    bool usesGray = false;                      // a Sobel filter of the whole image
+    std::shared_ptr<const GrayImage> gray;
+    bool grayComputed = false;                  // gray was made by this job
+};
 
-        m_data[i].r = clampedValue;
-        m_data[i].g = clampedValue;
-        m_data[i].b = clampedValue;
+/**
+ * @brief Called when the filter button is pressed in the UI. Starts the selected
+ * filter on a snapshot of the canvas in the background; the result replaces the
+ * canvas when it finishes, unless it was cancelled first. A result already in
+ * the cache replaces the canvas right away.
+ */
+void Canvas2D::filterImage() {
+    TRACE_SCOPE("filterImage");
+    cancelFilter();
+    if (m_filterThread.joinable()) {
+        m_filterThread.join();
     }
-}
 
-std::vector<float> triangleKernel(float support) {
-    int size = static_cast<int>(2 * support + 1);
-    std::vector<float> kernel(size);
-    float sum = 0.0f;
+    auto job = std::make_shared<FilterJob>();
+    job->params = settings;
+    if (settings.filterType != FILTER_SCALE) {
+        job->region = m_selection;
+    }
+    job->cacheKey = filterCacheKey(contentHash(), m_width, m_height, settings, job->region);
+    bool wholeImage = job->region.empty() || !filterRunsOnCrop(settings);
+    PixelRect crop{0, 0, m_width, m_height};
+    if (!wholeImage) {
+        // snapshot only the selection and the halo the filter reads around it
+        crop = job->region.bounds.expanded(filterHalo(settings)).clipped(m_width, m_height);
+        job->region = job->region.translated(-crop.x0, -crop.y0);
+        job->originX = crop.x0;
+        job->originY = crop.y0;
+    }
+    m_filterJob = job;
 
-    for (int i = 0; i < size; i++) {
-        float distance = std::fabs(i - support);
-        kernel[i] = 1.0f - distance / support;
-        sum += kernel[i];
+    if (std::shared_ptr<const Image> cached = m_filterCache.findResult(job->cacheKey)) {
+        job->image = Image{cached->width, cached->height, m_bufferPool.take(cached->data.size())};
+        std::copy(cached->data.begin(), cached->data.end(), job->image.data.begin());
+        job->cached = true;
+        finishFilter(job, true);
+        return;
     }
 
-    // normalize kernel
-    for (int i = 0; i < size; i++) {
-        kernel[i] /= sum;
+    job->image = cropImage(m_data.data(), m_width, crop, m_bufferPool);
+    if (settings.filterType == FILTER_MAPPING) {
+        job->stats = imageStats();
+    }
+    job->usesGray = settings.filterType == FILTER_EDGE_DETECT && !settings.edgeDetectCanny && wholeImage;
+    if (job->usesGray) {
+        job->gray = m_filterCache.findGray(job->cacheKey.content);
     }
 
-    return kernel;
+    m_filterThread = std::thread([this, job] {
+        if (job->usesGray && !job->gray) {
+            // made here rather than inside the filter so that it can be cached
+            auto gray = std::make_shared<GrayImage>();
+            gray->width = job->image.width;
+            gray->height = job->image.height;
+            gray->storage.resize(GrayImage::storagePixels(gray->width, gray->height));
+            FilterProgress untracked;
+            toGray(job->image, *gray, untracked);
+            job->gray = gray;
+            job->grayComputed = true;
+        }
+        bool completed = applyFilterRegion(job->image, job->params, m_bufferPool, job->progress, job->region,
+                                           job->stats.get(), job->gray.get());
+        QMetaObject::invokeMethod(this, [this, job, completed] {
+            finishFilter(job, completed);
+        }, Qt::QueuedConnection);
+    });
+
+    emit filterProgress(0, 1);
+    m_progressTimer->start();
 }
 
-std::vector<RGBA> Canvas2D::convolve1DHorizontal(std::vector<float> &kernel, std::vector<RGBA> &input) {
-    std::vector<RGBA> output(input.size(), RGBA{0, 0, 0, 255});
-    int kernelOffset = kernel.size() / 2;
-
-    for (int r = 0; r < m_height; r++) {
-        for (int c = 0; c < m_width; c++) {
-            float redAcc = 0.0f;
-            float greenAcc = 0.0f;
-            float blueAcc = 0.0f;
-
-            for (int k = -kernelOffset; k <= kernelOffset; k++) {
-                int colIndex = c + k;
+/**
+ * @brief Cancels the running filter, if any. Its result will be discarded.
+ */
+void Canvas2D::cancelFilter() {
+    if (!m_filterJob) {
+        return;
+    }
+    m_filterJob->progress.cancel();
+    m_filterJob.reset();
+    m_progressTimer->stop();
+    emit filterProgress(0, 1);
+}
 
-                if (colIndex < 0 || colIndex >= m_width) {
-                    continue;
-                }
+bool Canvas2D::isFilterRunning() const {
+    return m_filterJob != nullptr;
+}
 
-                int pixelIndex = r * m_width + colIndex;
-                RGBA pixel = input[pixelIndex];
+void Canvas2D::reportFilterProgress() {
+    if (m_filterJob) {
+        emit filterProgress(m_filterJob->progress.stripsDone, std::max(1, m_filterJob->progress.stripsTotal.load()));
+    }
+}
 
-                redAcc += kernel[k + kernelOffset] * pixel.r;
-                greenAcc += kernel[k + kernelOffset] * pixel.g;
-                blueAcc += kernel[k + kernelOffset] * pixel.b;
-            }
+/**
+ * @brief Runs on the GUI thread once a job thread is done, and swaps the result
+ * into the canvas if the job is still the current one. Whatever buffer the job
+ * ends up holding goes back to the pool.
+ */
+void Canvas2D::finishFilter(std::shared_ptr<FilterJob> job, bool completed) {
+    if (job != m_filterJob) {
+        m_bufferPool.give(std::move(job->image.data));
+        return;
+    }
+    m_filterJob.reset();
+    m_progressTimer->stop();
 
-            size_t index = r * m_width + c;
-            output[index].r = clamp(redAcc);
-            output[index].g = clamp(greenAcc);
-            output[index].b = clamp(blueAcc);
+    if (completed && !job->cached) {
+        m_filterCache.insertResult(job->cacheKey, std::make_shared<const Image>(job->image));
+        if (job->grayComputed) {
+            m_filterCache.insertGray(job->cacheKey.content, job->gray);
         }
     }
-
-    return output;
+    if (completed && !job->region.empty()) {
+        // everything outside the selection is unchanged
+        PixelRect rect = job->region.bounds.clipped(job->image.width, job->image.height);
+        for (int y = rect.y0; y < rect.y1; y++) {
+            auto row = job->image.data.begin() + std::size_t(y) * job->image.width;
+            std::copy(row + rect.x0, row + rect.x1,
+                      m_data.begin() + std::size_t(y + job->originY) * m_width + job->originX + rect.x0);
+        }
+        markDataChanged(rect.x0 + job->originX, rect.y0 + job->originY, rect.x1 + job->originX, rect.y1 + job->originY);
+        displayImage();
+    } else if (completed) {
+        if (job->image.width != m_width || job->image.height != m_height) {
+            clearSelection();
+        }
+        m_data.swap(job->image.data);
+        m_width = job->image.width;
+        m_height = job->image.height;
+        markDataChanged();
+        displayImage();
+    }
+    m_bufferPool.give(std::move(job->image.data));
+    emit filterProgress(1, 1);
 }
 
-std::vector<RGBA> Canvas2D::convolve1DVertical(std::vector<float> &kernel, std::vector<RGBA> &input) {
-    std::vector<RGBA> output(input.size(), RGBA{0, 0, 0, 255});
-    int kernelOffset = kernel.size() / 2;
-
-    for (int r = 0; r < m_height; r++) {
-        for (int c = 0; c < m_width; c++) {
-            float redAcc = 0.0f;
-            float greenAcc = 0.0f;
-            float blueAcc = 0.0f;
-
-            for (int k = -kernelOffset; k <= kernelOffset; k++) {
-                int rowIndex = r + k;
-
-                if (rowIndex < 0 || rowIndex >= m_height) {
-                    continue;
-                }
+/**
+ * FILTER PREVIEW
+ */
 
-                int pixelIndex = rowIndex * m_width + c;
-                RGBA pixel = input[pixelIndex];
+// Pixel count the preview proxy starts out with, and the time a preview may take
+constexpr int PREVIEW_PIXEL_BUDGET = 512 * 512;
+constexpr double PREVIEW_FRAME_BUDGET_MS = 16.0;
 
-                redAcc += kernel[k + kernelOffset] * pixel.r;
-                greenAcc += kernel[k + kernelOffset] * pixel.g;
-                blueAcc += kernel[k + kernelOffset] * pixel.b;
-            }
+// True if a and b would produce the same filter result
+static bool sameFilterParams(const Settings &a, const Settings &b) {
+    return filterParamsKey(a) == filterParamsKey(b);
+}
 
-            size_t index = r * m_width + c;
-            output[index].r = clamp(redAcc);
-            output[index].g = clamp(greenAcc);
-            output[index].b = clamp(blueAcc);
+/**
+ * @brief Shows the selected filter applied to a downsampled proxy of the canvas.
+ * Called whenever settings change; does nothing unless live preview is on and a
+ * filter parameter actually changed. The proxy factor adapts so that a preview
+ * fits in PREVIEW_FRAME_BUDGET_MS.
+ */
+void Canvas2D::updatePreview() {
+    if (!settings.filterPreview) {
+        if (m_previewShown) {
+            displayImage();
         }
+        return;
     }
-
-    return output;
-}
-
-void Canvas2D::filterScale() {
-    float scaleX = settings.scaleX;
-    float scaleY = settings.scaleY;
-
-    float supportX;
-    float supportY;
-
-    // scale x support
-    if (scaleX >= 1) { // upscale
-        supportX = 2.0f;
-    } else { // downscale
-        supportX = 2.0f / scaleX;
+    if (m_previewShown && sameFilterParams(settings, m_previewParams)) {
+        return;
     }
+    TRACE_SCOPE("updatePreview");
+    auto start = std::chrono::steady_clock::now();
 
-    // scale y support
-    if (scaleY >= 1) { // upscale
-        supportY = 2.0f;
-    } else { // downscale
-        supportY = 2.0f / scaleY;
+    if (m_previewFactor == 0) {
+        m_previewFactor = std::max(1, static_cast<int>(std::ceil(std::sqrt(m_width * m_height / double(PREVIEW_PIXEL_BUDGET)))));
     }
-
-    // normalize triangle kernels
-    std::vector<float> kernelX = triangleKernel(supportX);
-    float sumX = std::accumulate(kernelX.begin(), kernelX.end(), 0.0f);
-    for (auto &value : kernelX) {
-        value /= sumX;
+    if (m_previewProxyVersion != m_dataVersion || m_previewProxyFactor != m_previewFactor) {
+        m_previewProxy = downsampleBox(m_data.data(), m_width, m_height, m_previewFactor);
+        m_previewProxyHash = hashPixels(m_previewProxy.data.data(), m_previewProxy.data.size());
+        m_previewProxyVersion = m_dataVersion;
+        m_previewProxyFactor = m_previewFactor;
     }
 
-    std::vector<float> kernelY = triangleKernel(supportY);
-    float sumY = std::accumulate(kernelY.begin(), kernelY.end(), 0.0f);
-    for (auto &value : kernelY) {
-        value /= sumY;
+    // toggling back to earlier parameters shows the stored preview. Keyed on
+    // the proxy's pixels, which are cheap to hash, rather than the canvas's.
+    Settings params = proxyParams(settings, m_previewFactor);
+    FilterCacheKey key = filterCacheKey(m_previewProxyHash, m_previewProxy.width, m_previewProxy.height, params, {},
+                                        m_previewFactor);
+    std::shared_ptr<const Image> preview = m_filterCache.findResult(key);
+    bool cached = preview != nullptr;
+    if (!cached) {
+        auto filtered = std::make_shared<Image>(m_previewProxy);
+        FilterProgress progress;
+        // tone map the proxy with the full canvas's levels, so the preview matches the result
+        std::shared_ptr<const ImageStats> stats = settings.filterType == FILTER_MAPPING ? imageStats() : nullptr;
+        applyFilter(*filtered, params, m_bufferPool, progress, stats.get());
+        m_filterCache.insertResult(key, filtered);
+        preview = filtered;
     }
 
-    // horizontal pass
-    std::vector<RGBA> pass1Data = convolve1DHorizontal(kernelX, m_data);
-
-    // vertical pass
-    std::vector<RGBA> filteredData = convolve1DVertical(kernelY, pass1Data);
-
-    // resample
-    int newWidth = round(m_width * scaleX);
-    int newHeight = round(m_height * scaleY);
-    std::vector<RGBA> scaledData(newWidth * newHeight);
-
-    for (int r = 0; r < newHeight; r++) {
-        for (int c = 0; c < newWidth; c++) {
-            float originalX = c / scaleX;
-            float originalY = r / scaleY;
-
-            RGBA pixel = getPixelRepeated(filteredData, m_width, m_height, round(originalX), round(originalY));
-
-            int index = r * newWidth + c;
-            scaledData[index] = pixel;
-        }
+    QImage now = QImage((const uchar*)preview->data.data(), preview->width, preview->height, QImage::Format_RGBX8888);
+    int displayWidth = preview->width * m_previewFactor;
+    int displayHeight = preview->height * m_previewFactor;
+    m_previewImage = now.scaled(displayWidth, displayHeight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    updateDisplaySize();
+    update();
+    m_previewShown = true;
+    m_previewParams = settings;
+    if (cached) {
+        return;
     }
 
-    // update canvas
-    m_data = scaledData;
-    m_width = newWidth;
-    m_height = newHeight;
-}
-
-/**
- * @brief Called when the filter button is pressed in the UI
- */
-void Canvas2D::filterImage() {
-    switch (settings.filterType) {
-    case FILTER_BLUR:
-        filterBlur();
-        break;
-    case FILTER_EDGE_DETECT:
-        filterEdgeDetect();
-        break;
-    case FILTER_SCALE:
-        filterScale();
-        break;
-    default:
-        break;
+    // trade resolution for latency on the next parameter change
+    double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (elapsedMs > PREVIEW_FRAME_BUDGET_MS && preview->width > 64 && preview->height > 64) {
+        m_previewFactor++;
+    } else if (elapsedMs < PREVIEW_FRAME_BUDGET_MS / 4 && m_previewFactor > 1) {
+        m_previewFactor--;
     }
-
-    displayImage();
 }
 
 /**
@@ -431,10 +486,18 @@ void Canvas2D::filterImage() {
  * @brief Called when any of the parameters in the UI are modified.
  */
 void Canvas2D::settingsChanged() {
-    // this saves your UI settings locally to load next time you run the program
-    settings.saveSettings();
+    // this saves your UI settings locally to load next time you run the program,
+    // once the controls settle
+    m_settingsWriter->settingsChanged(settings);
+
+    // a filter started with other parameters is now stale; brush changes and
+    // parameters the filter does not read leave it running
+    if (m_filterJob && !sameFilterParams(settings, m_filterJob->params)) {
+        cancelFilter();
+    }
+    // the preview and the brush mask rebuild themselves only if what they depend on changed
+    updatePreview();
 
-    // TODO: fill in what you need to do when brush or filter parameters change
     m_brushRadius = settings.brushRadius; // getting updated brush radius
 }
 
@@ -444,18 +507,6 @@ int Canvas2D::posToIndex(int x, int y) {
     return index;
 }
 
-RGBA Canvas2D::color(const RGBA &original, const RGBA &brush, float maskValue) {
-    float alphaMix = maskValue * (brush.a / 255.0f);
-
-    RGBA color;
-    color.r = static_cast<std::uint8_t>(original.r * (1.0f - alphaMix) + brush.r * alphaMix + 0.5f);
-    color.g = static_cast<std::uint8_t>(original.g * (1.0f - alphaMix) + brush.g * alphaMix + 0.5f);
-    color.b = static_cast<std::uint8_t>(original.b * (1.0f - alphaMix) + brush.b * alphaMix + 0.5f);
-    color.a = original.a;
-
-    return color;
-}
-
 float Canvas2D::getMaskValue(float distance, int radius) {
     float A = 1.0f / (radius * radius);
     float B = -2.0f / radius;
@@ -478,75 +529,151 @@ float Canvas2D::getMaskValue(float distance, int radius) {
     }
 }
 
-void Canvas2D::applyBrush(int x, int y) {
-    int R = m_brushRadius;
-
-    for (int i = -R; i <= R; i++) {
-        for (int j = -R; j <= R; j++) {
-            int brushX = x + i; // current pixel's x value within brush mask
-            int brushY = y + j; // current pixel's y value within brush mask
-
-            // checking if brush x and y values are within canvas bounds
-            if (brushX >= 0 && brushX < m_width && brushY >= 0 && brushY < m_height) {
-                float distance = sqrt(i * i + j * j);
-
-                // checking if pixel is within radius length of brush center
-                if (distance <= R) {
-                    int index = posToIndex(brushX, brushY);
-                    float maskValue = getMaskValue(distance, R); // mask value based on brush type
-
-                    RGBA colorToApply;
-                    if (settings.brushType == BRUSH_SMUDGE) {
-                        colorToApply = m_tempColor[(i + R) * (2 * R + 1) + (j + R)];
-                    } else {
-                        colorToApply = settings.brushColor;
-                    }
-
-                    m_data[index] = color(m_data[index], colorToApply, maskValue);
-                }
+/**
+ * @brief Rebuilds the 8-bit brush mask if the brush radius or type changed
+ */
+void Canvas2D::updateBrushMask() {
+    int R = settings.brushRadius;
+    if (R == m_brushMaskRadius && settings.brushType == m_brushMaskType) {
+        return;
+    }
+    m_brushMaskRadius = R;
+    m_brushMaskType = settings.brushType;
+
+    int size = 2 * R + 1;
+    m_brushMask.assign(size * size, 0);
+    for (int j = -R; j <= R; j++) {
+        for (int i = -R; i <= R; i++) {
+            float distance = sqrt(i * i + j * j);
+            if (distance <= R) {
+                float maskValue = R > 0 ? getMaskValue(distance, R) : 1.0f;
+                m_brushMask[(j + R) * size + (i + R)] = static_cast<std::uint8_t>(std::clamp(maskValue, 0.0f, 1.0f) * 255.0f + 0.5f);
             }
         }
     }
 }
 
-void Canvas2D::pickUpSmudge(int x, int y) {
-    int R = settings.brushRadius;
-    int maskSize = (2 * R + 1) * (2 * R + 1);
-
-    m_tempColor.clear();
-    m_tempColor.resize(maskSize, RGBA{0, 0, 0, 0});
-
-    for (int i = -R; i <= R; i++) {
-        for (int j = -R; j <= R; j++) {
-            int brushX = x + i;
-            int brushY = y + j;
-
-            if (brushX >= 0 && brushX < m_width && brushY >= 0 && brushY < m_height) {
-                int index = posToIndex(brushX, brushY);
-                m_tempColor[(i + R) * (2 * R + 1) + (j + R)] = m_data[index];
-            } else {
-                // when picking up on edge, fill pixels with RGBA(0,0,0,0)
-                m_tempColor[(i + R) * (2 * R + 1) + (j + R)] = RGBA{0, 0, 0, 0};
+void Canvas2D::applyBrush(int x, int y) {
+    updateBrushMask();
+    stampMask(x, y, m_brushMask.data(), m_brushMaskRadius);
+}
+
+/**
+ * @brief Paints the brush color through a (2R + 1)^2 coverage mask centered on (x, y)
+ */
+void Canvas2D::stampMask(int x, int y, const std::uint8_t *mask, int R) {
+    int size = 2 * R + 1;
+
+    // clip the brush square to the canvas
+    int xBegin = std::max(0, x - R);
+    int xEnd = std::min(m_width - 1, x + R);
+    int yBegin = std::max(0, y - R);
+    int yEnd = std::min(m_height - 1, y + R);
+    int count = xEnd - xBegin + 1;
+    bool layered = settings.fixAlphaBlending && m_strokeBase.size() == m_data.size();
+
+    for (int brushY = yBegin; brushY <= yEnd && count > 0; brushY++) {
+        const std::uint8_t *maskRow = &mask[(brushY - y + R) * size + (xBegin - x + R)];
+        int index = posToIndex(xBegin, brushY);
+
+        if (layered) {
+            // the stroke keeps the strongest coverage each pixel has seen and is
+            // composited over the canvas as it was before the stroke
+            std::uint8_t *coverage = &m_strokeCoverage[index];
+            for (int i = 0; i < count; i++) {
+                coverage[i] = std::max(coverage[i], maskRow[i]);
             }
+            blendSpan(&m_data[index], &m_strokeBase[index], coverage, settings.brushColor, count, BLEND_OVER,
+                      settings.linearLight);
+        } else {
+            blendSpan(&m_data[index], &m_data[index], maskRow, settings.brushColor, count, BLEND_MIX, settings.linearLight);
         }
     }
 }
 
+// Drag distance per event at which the speed brush is thinnest, and how thin it gets
+constexpr float SPEED_THINNEST_DISTANCE = 40.0f;
+constexpr float SPEED_MIN_FRACTION = 0.2f;
+
+/**
+ * @brief Stamps a disk whose radius shrinks the faster the mouse moves. The
+ * radius is smoothed across events and snapped to the nearest precomputed level.
+ */
+void Canvas2D::speedBrush(int x, int y, bool strokeStart) {
+    if (m_speedStamp.empty()) {
+        m_speedStamp.makeDisk();
+    }
+    if (strokeStart) {
+        m_speedRadius = settings.brushRadius;
+    } else {
+        float distance = std::hypot(float(x - m_lastX), float(y - m_lastY));
+        float fraction = std::clamp(1.0f - distance / SPEED_THINNEST_DISTANCE, SPEED_MIN_FRACTION, 1.0f);
+        m_speedRadius = 0.5f * m_speedRadius + 0.5f * settings.brushRadius * fraction;
+    }
+
+    int R = std::clamp(static_cast<int>(std::lround(m_speedRadius)), 0, StampBrush::MAX_RADIUS);
+    stampMask(x, y, m_speedStamp.level(R), R);
+}
+
+// Loads the custom stamp if nothing is loaded yet: the saved stamp, else a plain disk
+void Canvas2D::ensureCustomStamp() {
+    if (m_customStamp.empty()) {
+        if (settings.brushStampPath.isEmpty() || !m_customStamp.loadImage(settings.brushStampPath)) {
+            m_customStamp.makeDisk();
+        }
+    }
+}
+
+void Canvas2D::customBrush(int x, int y) {
+    ensureCustomStamp();
+    int R = std::clamp(settings.brushRadius, 0, StampBrush::MAX_RADIUS);
+    stampMask(x, y, m_customStamp.level(R), R);
+}
+
+bool Canvas2D::loadBrushStamp(const QString &file) {
+    if (!m_customStamp.loadImage(file)) {
+        std::cout << "Failed to load brush stamp" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Snapshots the canvas at the start of a stroke when fixAlphaBlending is on
+ */
+void Canvas2D::beginStroke() {
+    if (!settings.fixAlphaBlending) {
+        return;
+    }
+    m_strokeBase = m_bufferPool.take(m_data.size());
+    std::copy(m_data.begin(), m_data.end(), m_strokeBase.begin());
+    m_strokeCoverage.assign(m_data.size(), 0);
+}
+
+void Canvas2D::endStroke() {
+    if (!m_strokeBase.empty()) {
+        m_bufferPool.give(std::move(m_strokeBase));
+        m_strokeBase.clear();
+    }
+}
+
 void Canvas2D::sprayBrush(int x, int y) {
     int R = settings.brushRadius;
     int maskDim = 2 * R + 1;
     int sprayDensity = (settings.brushDensity / 100.0) * (M_PI * R * R); // brush density percentage x area of brush
 
     for (int i = 0; i < sprayDensity; i++) {
-        int randX = x - R + arc4random() % maskDim;
-        int randY = y - R + arc4random() % maskDim;
+        int randX = x - R + m_sprayRandom() % maskDim;
+        int randY = y - R + m_sprayRandom() % maskDim;
 
         if (randX >= 0 && randX < m_width && randY >= 0 && randY < m_height) {
             float distance = sqrt((randX - x) * (randX - x) + (randY - y) * (randY - y));
             if (distance <= R) {
                 int index = posToIndex(randX, randY);
                 if (index >= 0 && index < m_data.size()) {
-                    m_data[index] = settings.brushColor;
+                    m_data[index] = settings.fixAlphaBlending
+                                        ? blendPixel(m_data[index], settings.brushColor, 255, BLEND_OVER, settings.linearLight)
+                                        : settings.brushColor;
                 }
             }
         }
@@ -595,56 +722,300 @@ void Canvas2D::fillBucket(int x, int y) {
     }
 }
 
+/**
+ * @brief Sets the selection to the rectangle between where the select drag
+ * started and (x, y), inclusive, clipped to the canvas
+ */
+void Canvas2D::selectTo(int x, int y) {
+    PixelRect bounds{std::min(x, m_selectStartX), std::min(y, m_selectStartY),
+                     std::max(x, m_selectStartX) + 1, std::max(y, m_selectStartY) + 1};
+    m_selection = FilterRegion{};
+    // a click selects nothing
+    if (x != m_selectStartX || y != m_selectStartY) {
+        m_selection.bounds = bounds.clipped(m_width, m_height);
+    }
+    update();
+}
+
+void Canvas2D::clearSelection() {
+    m_selection = FilterRegion{};
+    update();
+}
+
 /**
  * @brief These functions are called when the mouse is clicked and dragged on the canvas
  */
 void Canvas2D::mouseDown(int x, int y) {
+    TRACE_SCOPE("mouseDown");
+    // brush input is ignored while a filter is rewriting the canvas
+    if (isFilterRunning()) {
+        return;
+    }
+    if (settings.brushType == BRUSH_SELECT) {
+        m_isDown = true;
+        m_selectStartX = x;
+        m_selectStartY = y;
+        clearSelection();
+        return;
+    }
+    recordEvent(StrokeEvent::DOWN, x, y);
     m_isDown = true;
     switch (settings.brushType) {
     case BRUSH_CONSTANT:
     case BRUSH_LINEAR:
     case BRUSH_QUADRATIC:
+        beginStroke();
         applyBrush(x,y);
+        m_stampCount++;
         break;
     case BRUSH_SMUDGE:
-        pickUpSmudge(x,y);
+        m_smudge.begin(m_data, m_width, m_height, x, y, settings.brushRadius);
+        break;
+    case BRUSH_SPEED:
+        beginStroke();
+        speedBrush(x, y, true);
+        m_stampCount++;
+        break;
+    case BRUSH_CUSTOM:
+        beginStroke();
+        customBrush(x, y);
+        m_stampCount++;
         break;
     case BRUSH_SPRAY:
         sprayBrush(x, y);
+        m_stampCount++;
         break;
     case BRUSH_FILL:
         fillBucket(x, y);
+        m_stampCount++;
         break;
     default:
         break;
     }
 
+    if (settings.brushType == BRUSH_FILL) {
+        markDataChanged();
+    } else {
+        int R = settings.brushRadius + 1;
+        markDataChanged(x - R, y - R, x + R + 1, y + R + 1);
+    }
+    m_lastX = x;
+    m_lastY = y;
     displayImage();
 }
 
 void Canvas2D::mouseDragged(int x, int y) {
+    TRACE_SCOPE("mouseDragged");
+    if (isFilterRunning()) {
+        return;
+    }
+    if (m_isDown && settings.brushType == BRUSH_SELECT) {
+        selectTo(x, y);
+        return;
+    }
     if (m_isDown == true) {
+        recordEvent(StrokeEvent::DRAG, x, y);
         switch (settings.brushType) {
         case BRUSH_CONSTANT:
         case BRUSH_LINEAR:
         case BRUSH_QUADRATIC:
             applyBrush(x, y);
+            m_stampCount++;
             break;
         case BRUSH_SMUDGE:
-            applyBrush(x,y);
-            pickUpSmudge(x,y);
+            m_stampCount += m_smudge.dragTo(m_data, m_width, m_height, x, y);
+            break;
+        case BRUSH_SPEED:
+            speedBrush(x, y, false);
+            m_stampCount++;
+            break;
+        case BRUSH_CUSTOM:
+            customBrush(x, y);
+            m_stampCount++;
             break;
         case BRUSH_SPRAY:
             sprayBrush(x, y);
+            m_stampCount++;
             break;
         default:
             break;
         }
+        // smudge dabs follow the whole segment from the last position
+        int R = settings.brushRadius + 1;
+        markDataChanged(std::min(x, m_lastX) - R, std::min(y, m_lastY) - R,
+                        std::max(x, m_lastX) + R + 1, std::max(y, m_lastY) + R + 1);
+        m_lastX = x;
+        m_lastY = y;
     }
 
     displayImage();
 }
 
 void Canvas2D::mouseUp(int x, int y) {
+    TRACE_SCOPE("mouseUp");
+    if (m_isDown && settings.brushType == BRUSH_SELECT) {
+        m_isDown = false;
+        selectTo(x, y);
+        return;
+    }
+    if (m_isDown) {
+        recordEvent(StrokeEvent::UP, x, y);
+    }
+    m_isDown = false;
+    endStroke();
+}
+
+/**
+ * STROKE RECORDING
+ */
+
+void Canvas2D::setHeadless(bool headless) {
+    m_headless = headless;
+}
+
+/**
+ * @brief Starts recording brush events. The spray generator is reseeded so the
+ * recording can be replayed exactly.
+ */
+void Canvas2D::startRecording() {
+    m_recording = std::make_unique<StrokeRecording>();
+    m_recording->width = m_width;
+    m_recording->height = m_height;
+    m_recording->seed = std::random_device()();
+    m_sprayRandom.seed(m_recording->seed);
+    m_recordingStart = std::chrono::steady_clock::now();
+    m_recordingStartVersion = m_dataVersion;
+    m_recordingFromBlank = std::all_of(m_data.begin(), m_data.end(), [](const RGBA &pixel) {
+        return pixel.r == 255 && pixel.g == 255 && pixel.b == 255 && pixel.a == 255;
+    });
+}
+
+/**
+ * @brief Stops recording and writes the recording to file, or discards it if
+ * file is empty. The final canvas hash is only stored if replaying the strokes
+ * on a blank canvas reproduces it.
+ */
+bool Canvas2D::stopRecording(const QString &file) {
+    if (!m_recording) {
+        return false;
+    }
+    std::unique_ptr<StrokeRecording> recording = std::move(m_recording);
+    if (file.isEmpty()) {
+        return false;
+    }
+
+    // each recorded down and drag changed the canvas exactly once
+    std::uint64_t strokeChanges = std::count_if(recording->events.begin(), recording->events.end(),
+                                                [](const StrokeEvent &event) { return event.type != StrokeEvent::UP; });
+    if (m_recordingFromBlank && m_dataVersion - m_recordingStartVersion == strokeChanges &&
+        m_width == recording->width && m_height == recording->height) {
+        recording->finalHash = canvasHash(m_data);
+    }
+
+    if (!recording->save(file)) {
+        std::cout << "Failed to save stroke recording" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Canvas2D::isRecording() const {
+    return m_recording != nullptr;
+}
+
+void Canvas2D::recordEvent(StrokeEvent::Type type, int x, int y) {
+    if (!m_recording) {
+        return;
+    }
+    std::int64_t timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - m_recordingStart).count();
+    m_recording->events.push_back(StrokeEvent{type, x, y, timeUs});
+    if (type == StrokeEvent::DOWN) {
+        BrushState brush = brushState(settings);
+        if (brush.brushType == BRUSH_CUSTOM) {
+            // the stamp goes with the strokes, stored once however often it is used
+            ensureCustomStamp();
+            std::vector<std::vector<float>> &stamps = m_recording->stamps;
+            auto found = std::find(stamps.begin(), stamps.end(), m_customStamp.master());
+            if (found == stamps.end()) {
+                found = stamps.insert(stamps.end(), m_customStamp.master());
+            }
+            brush.stamp = static_cast<int>(found - stamps.begin());
+        }
+        m_recording->brushes.push_back(brush);
+    }
+}
+
+/**
+ * @brief Replays a recording on a blank canvas of its size, as fast as possible
+ * and without rendering, timing every mouse handler call. Custom strokes use
+ * the stamps stored with them. Restores the brush settings and stamp
+ * afterwards; the canvas keeps the replayed result.
+ */
+ReplayStats Canvas2D::replayStrokes(const StrokeRecording &recording) {
+    TRACE_SCOPE("replayStrokes");
+    cancelFilter();
+    std::unique_ptr<StrokeRecording> paused = std::move(m_recording);
+    Settings saved = settings;
+    StampBrush savedStamp = m_customStamp;
+    int loadedStamp = -1;
+    bool wasHeadless = m_headless;
+    m_headless = true;
+
+    m_width = recording.width;
+    m_height = recording.height;
+    m_data.assign(m_width * m_height, RGBA{255, 255, 255, 255});
+    clearSelection();
+    markDataChanged();
+    m_sprayRandom.seed(recording.seed);
     m_isDown = false;
+    m_stampCount = 0;
+
+    std::vector<double> latenciesUs;
+    latenciesUs.reserve(recording.events.size());
+    size_t brush = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const StrokeEvent &event : recording.events) {
+        if (event.type == StrokeEvent::DOWN) {
+            const BrushState &state = recording.brushes[brush++];
+            applyBrushState(state, settings);
+            if (state.brushType == BRUSH_CUSTOM && state.stamp >= 0 && state.stamp != loadedStamp) {
+                const std::vector<float> &master = recording.stamps[state.stamp];
+                if (master.empty()) {
+                    m_customStamp.makeDisk();
+                } else {
+                    m_customStamp.loadMaster(master);
+                }
+                loadedStamp = state.stamp;
+            }
+        }
+        auto eventStart = std::chrono::steady_clock::now();
+        switch (event.type) {
+        case StrokeEvent::DOWN:
+            mouseDown(event.x, event.y);
+            break;
+        case StrokeEvent::DRAG:
+            mouseDragged(event.x, event.y);
+            break;
+        case StrokeEvent::UP:
+            mouseUp(event.x, event.y);
+            break;
+        }
+        latenciesUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - eventStart).count());
+    }
+
+    ReplayStats stats;
+    stats.events = static_cast<int>(recording.events.size());
+    stats.stamps = m_stampCount;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.stampsPerSecond = stats.seconds > 0.0 ? stats.stamps / stats.seconds : 0.0;
+    stats.hash = canvasHash(m_data);
+    summarizeLatencies(latenciesUs, stats);
+
+    settings = saved;
+    m_customStamp = std::move(savedStamp);
+    m_headless = wasHeadless;
+    m_recording = std::move(paused);
+    displayImage();
+    return stats;
 }
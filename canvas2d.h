@@ -3,8 +3,24 @@
 
 #include <QLabel>
 #include <QMouseEvent>
+#include <QTimer>
 #include <array>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include "filter.h"
+#include "filtercache.h"
+#include "pyramid.h"
+#include "region.h"
 #include "rgba.h"
+#include "settings.h"
+#include "settingswriter.h"
+#include "smudge.h"
+#include "stamp.h"
+#include "strokes.h"
+
+struct FilterJob;
 
 class Canvas2D : public QLabel {
     Q_OBJECT
@@ -12,6 +28,8 @@ public:
     int m_width = 0;
     int m_height = 0;
 
+    ~Canvas2D();
+
     void init();
     void clearCanvas();
     bool loadImageFromFile(const QString &file);
@@ -22,8 +40,30 @@ public:
     // This will be called when the settings have changed
     void settingsChanged();
 
-    // Filter TODO: implement
+    // Filters run in the background; brush input is ignored until they finish
     void filterImage();
+    void cancelFilter();
+    bool isFilterRunning() const;
+
+    // Sets the image the custom brush stamps
+    bool loadBrushStamp(const QString &file);
+
+    // Display scale; below 1 the canvas is drawn from a mip level
+    void setZoom(float zoom);
+    float zoom() const { return m_zoom; }
+
+    // Headless canvases never render; used for replays and benchmarks
+    void setHeadless(bool headless);
+
+    // Brush strokes can be recorded to a file and replayed (see strokes.h)
+    void startRecording();
+    bool stopRecording(const QString &file);
+    bool isRecording() const;
+    ReplayStats replayStrokes(const StrokeRecording &recording);
+
+signals:
+    // Emitted while a filter runs, in units of processed strips
+    void filterProgress(int done, int total);
 
 private:
     std::vector<RGBA> m_data;
@@ -38,19 +78,28 @@ private:
     // that you will have to fill in.
     virtual void mousePressEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseDown(static_cast<int>(x), static_cast<int>(y));
+        mouseDown(static_cast<int>(x / m_zoom), static_cast<int>(y / m_zoom));
     }
     virtual void mouseMoveEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseDragged(static_cast<int>(x), static_cast<int>(y));
+        mouseDragged(static_cast<int>(x / m_zoom), static_cast<int>(y / m_zoom));
     }
     virtual void mouseReleaseEvent(QMouseEvent* event) override {
         auto [x, y] = std::array{ event->position().x(), event->position().y() };
-        mouseUp(static_cast<int>(x), static_cast<int>(y));
+        mouseUp(static_cast<int>(x / m_zoom), static_cast<int>(y / m_zoom));
     }
+    virtual void paintEvent(QPaintEvent *event) override;
+    // Ctrl + wheel zooms
+    virtual void wheelEvent(QWheelEvent *event) override;
+
+    // VIEW:
+    DisplayPyramid m_view;
+    float m_zoom = 1.0f;
+    QImage m_previewImage;
+    void updateDisplaySize();
 
     // BRUSH:
-    std::vector<RGBA> m_tempColor;
+    SmudgeBrush m_smudge;
 
     int currentBrush;
     RGBA currentColor;
@@ -62,13 +111,46 @@ private:
 
     float getMaskValue(float distance, int radius);
     void applyBrush(int x, int y);
+    void stampMask(int x, int y, const std::uint8_t *mask, int R);
+
+    // Brush mask as 8-bit coverage, rebuilt when the radius or brush type changes
+    std::vector<std::uint8_t> m_brushMask;
+    int m_brushMaskRadius = -1;
+    int m_brushMaskType = -1;
+    void updateBrushMask();
 
-    void pickUpSmudge(int x, int y);
+    // With fixAlphaBlending on, a stroke is a coverage layer composited over a
+    // snapshot of the canvas, so overlapping dabs do not stack up opacity
+    std::vector<RGBA> m_strokeBase;
+    std::vector<std::uint8_t> m_strokeCoverage;
+    void beginStroke();
+    void endStroke();
+
+    // Dabs, smudge dabs, spray bursts and fills so far, for replay stats
+    std::uint64_t m_stampCount = 0;
 
     // Extra Credit
+    std::minstd_rand m_sprayRandom;
     void sprayBrush(int x, int y);
+
+    StampBrush m_speedStamp;
+    StampBrush m_customStamp;
+    float m_speedRadius = 0.0f;
+    int m_lastX = 0;
+    int m_lastY = 0;
+    void speedBrush(int x, int y, bool strokeStart);
+    void customBrush(int x, int y);
+    void ensureCustomStamp();
+
     void fillBucket(int x, int y);
-    RGBA color(const RGBA &original, const RGBA &brush, float maskValue);
+
+    // Filters only touch the selection when there is one; a click without a
+    // drag clears it
+    FilterRegion m_selection;
+    int m_selectStartX = 0;
+    int m_selectStartY = 0;
+    void selectTo(int x, int y);
+    void clearSelection();
 
     // FILTER:
     int currFilterType;
@@ -77,14 +159,55 @@ private:
 
     RGBA bilinearInterpolation(float x, float y, std::vector<RGBA>& data, int width, int height);
 
-    std::vector<RGBA> convolve2D(std::vector<float> kernel);
-    std::vector<RGBA> convolve1DHorizontal(std::vector<float> &kernel, std::vector<RGBA> &input);
-    std::vector<RGBA> convolve1DVertical(std::vector<float> &kernel, std::vector<RGBA> &input);
-
-    void filterBlur();
-    void filterGray();
-    void filterEdgeDetect();
-    void filterScale();
+    // The filters themselves live in filter.h; these manage the background job
+    std::shared_ptr<FilterJob> m_filterJob;
+    BufferPool m_bufferPool;
+    std::thread m_filterThread;
+    QTimer *m_progressTimer = nullptr;
+
+    void reportFilterProgress();
+    void finishFilter(std::shared_ptr<FilterJob> job, bool completed);
+
+    // Incremented on every change to m_data
+    std::uint64_t m_dataVersion = 0;
+    void markDataChanged();
+    void markDataChanged(int x0, int y0, int x1, int y1);
+
+    // Statistics of m_data, recomputed on demand once m_dataVersion moves on
+    std::shared_ptr<const ImageStats> m_stats;
+    std::uint64_t m_statsVersion = ~0ull;
+    std::shared_ptr<const ImageStats> imageStats();
+
+    // Results and sub-results of earlier filters and previews, keyed by the
+    // hash of the pixels they started from, which is computed once per version
+    FilterCache m_filterCache;
+    std::uint64_t m_contentHash = 0;
+    std::uint64_t m_contentHashVersion = ~0ull;
+    std::uint64_t contentHash();
+
+    // Live preview on a cached downsampled proxy of m_data
+    Image m_previewProxy;
+    std::uint64_t m_previewProxyVersion = ~0ull;
+    std::uint64_t m_previewProxyHash = 0;
+    int m_previewProxyFactor = 0;
+    int m_previewFactor = 0;
+    bool m_previewShown = false;
+    Settings m_previewParams;
+
+    void updatePreview();
+
+    bool m_headless = false;
+
+    // Persists settings changes in the background, debounced
+    std::unique_ptr<SettingsWriter> m_settingsWriter;
+
+    // Stroke recording in progress, if any
+    std::unique_ptr<StrokeRecording> m_recording;
+    std::chrono::steady_clock::time_point m_recordingStart;
+    std::uint64_t m_recordingStartVersion = 0;
+    bool m_recordingFromBlank = false;
+
+    void recordEvent(StrokeEvent::Type type, int x, int y);
 
     // Extra Credit
 };
@@ -0,0 +1,635 @@
+#include "convolve.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <tuple>
+#include <utility>
+#include "filter.h"
+
+int borderIndex(int index, int limit, BorderMode border) {
+    if (index >= 0 && index < limit) {
+        return index;
+    }
+    switch (border) {
+    case BORDER_CLAMP:
+        return std::clamp(index, 0, limit - 1);
+    case BORDER_MIRROR: {
+        if (limit == 1) {
+            return 0;
+        }
+        int period = 2 * (limit - 1);
+        int folded = std::abs(index) % period;
+        return folded < limit ? folded : period - folded;
+    }
+    case BORDER_WRAP:
+        return ((index % limit) + limit) % limit;
+    default:
+        return -1;
+    }
+}
+
+namespace {
+
+// Kernels summing to about zero (e.g. derivatives) are never renormalized
+inline bool canRenormalize(float sum) {
+    return std::fabs(sum) > 1e-6f;
+}
+
+inline RGBA packPixel(float redAcc, float greenAcc, float blueAcc) {
+    return RGBA{clamp(redAcc), clamp(greenAcc), clamp(blueAcc), 255};
+}
+
+/**
+ * FLOAT
+ */
+
+// One border output pixel. `line` points at the first pixel of the row (or
+// column) being convolved and `stride` is the distance between neighbouring
+// taps in pixels: 1 horizontally, the width vertically.
+RGBA convolvePixelBorder(const float *kernel, int radius, BorderMode border, float kernelSum,
+                         const RGBA *line, int position, int limit, int stride) {
+    float redAcc = 0.0f;
+    float greenAcc = 0.0f;
+    float blueAcc = 0.0f;
+    float usedWeight = 0.0f;
+
+    for (int k = -radius; k <= radius; k++) {
+        int index = borderIndex(position + k, limit, border);
+
+        if (index < 0) {
+            continue;
+        }
+
+        const RGBA &pixel = line[size_t(index) * stride];
+        redAcc += kernel[k + radius] * pixel.r;
+        greenAcc += kernel[k + radius] * pixel.g;
+        blueAcc += kernel[k + radius] * pixel.b;
+        usedWeight += kernel[k + radius];
+    }
+
+    if (border == BORDER_ZERO_RENORMALIZED && canRenormalize(kernelSum) && canRenormalize(usedWeight)) {
+        float scale = kernelSum / usedWeight;
+        redAcc *= scale;
+        greenAcc *= scale;
+        blueAcc *= scale;
+    }
+
+    return packPixel(redAcc, greenAcc, blueAcc);
+}
+
+// One interior output pixel: every tap is in bounds
+inline RGBA convolvePixelInterior(const float *kernel, int radius, const RGBA *center, int stride) {
+    float redAcc = 0.0f;
+    float greenAcc = 0.0f;
+    float blueAcc = 0.0f;
+
+    for (int k = -radius; k <= radius; k++) {
+        const RGBA &pixel = center[k * stride];
+        redAcc += kernel[k + radius] * pixel.r;
+        greenAcc += kernel[k + radius] * pixel.g;
+        blueAcc += kernel[k + radius] * pixel.b;
+    }
+
+    return packPixel(redAcc, greenAcc, blueAcc);
+}
+
+// One interior output pixel with the tap loop unrolled. The fold expands to
+// exactly 2 * R + 1 multiply-adds in tap order, so results match the loop.
+template <int R, std::size_t... I>
+inline RGBA convolvePixelUnrolled(const std::array<float, 2 * R + 1> &kernel, const RGBA *center,
+                                  int stride, std::index_sequence<I...>) {
+    float redAcc = 0.0f;
+    float greenAcc = 0.0f;
+    float blueAcc = 0.0f;
+
+    ((redAcc += kernel[I] * center[(int(I) - R) * stride].r,
+      greenAcc += kernel[I] * center[(int(I) - R) * stride].g,
+      blueAcc += kernel[I] * center[(int(I) - R) * stride].b), ...);
+
+    return packPixel(redAcc, greenAcc, blueAcc);
+}
+
+float kernelSumOf(const float *kernel, int radius) {
+    float sum = 0.0f;
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        sum += kernel[i];
+    }
+    return sum;
+}
+
+template <class InteriorPixel>
+void horizontalRows(const float *kernel, int radius, BorderMode border, const RGBA *input, RGBA *output,
+                    int width, int rowBegin, int rowEnd, InteriorPixel interiorPixel) {
+    float kernelSum = kernelSumOf(kernel, radius);
+    int interiorBegin = std::min(radius, width);
+    int interiorEnd = std::max(interiorBegin, width - radius);
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const RGBA *rowIn = input + size_t(r) * width;
+        RGBA *rowOut = output + size_t(r) * width;
+
+        for (int c = 0; c < interiorBegin; c++) {
+            rowOut[c] = convolvePixelBorder(kernel, radius, border, kernelSum, rowIn, c, width, 1);
+        }
+        for (int c = interiorBegin; c < interiorEnd; c++) {
+            rowOut[c] = interiorPixel(rowIn + c);
+        }
+        for (int c = interiorEnd; c < width; c++) {
+            rowOut[c] = convolvePixelBorder(kernel, radius, border, kernelSum, rowIn, c, width, 1);
+        }
+    }
+}
+
+template <class InteriorPixel>
+void verticalRows(const float *kernel, int radius, BorderMode border, const RGBA *input, RGBA *output,
+                  int width, int height, int rowBegin, int rowEnd, InteriorPixel interiorPixel) {
+    float kernelSum = kernelSumOf(kernel, radius);
+    // per-thread scratch, so strips on pool workers never hit the allocator
+    thread_local std::vector<const RGBA *> tapRows;
+    thread_local std::vector<float> tapWeights;
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const RGBA *rowIn = input + size_t(r) * width;
+        RGBA *rowOut = output + size_t(r) * width;
+
+        if (r >= radius && r < height - radius) {
+            for (int c = 0; c < width; c++) {
+                rowOut[c] = interiorPixel(rowIn + c);
+            }
+            continue;
+        }
+
+        // border row: resolve every tap's source row once for the whole row
+        tapRows.clear();
+        tapWeights.clear();
+        float usedWeight = 0.0f;
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(r + k, height, border);
+            if (index < 0) {
+                continue;
+            }
+            tapRows.push_back(input + size_t(index) * width);
+            tapWeights.push_back(kernel[k + radius]);
+            usedWeight += kernel[k + radius];
+        }
+        float scale = 1.0f;
+        if (border == BORDER_ZERO_RENORMALIZED && canRenormalize(kernelSum) && canRenormalize(usedWeight)) {
+            scale = kernelSum / usedWeight;
+        }
+
+        for (int c = 0; c < width; c++) {
+            float redAcc = 0.0f;
+            float greenAcc = 0.0f;
+            float blueAcc = 0.0f;
+            for (size_t t = 0; t < tapRows.size(); t++) {
+                const RGBA &pixel = tapRows[t][c];
+                redAcc += tapWeights[t] * pixel.r;
+                greenAcc += tapWeights[t] * pixel.g;
+                blueAcc += tapWeights[t] * pixel.b;
+            }
+            if (scale != 1.0f) {
+                redAcc *= scale;
+                greenAcc *= scale;
+                blueAcc *= scale;
+            }
+            rowOut[c] = packPixel(redAcc, greenAcc, blueAcc);
+        }
+    }
+}
+
+void convolveRowsHorizontalGeneric(const float *kernel, int radius, BorderMode border, const RGBA *input, RGBA *output,
+                                   int width, int, int rowBegin, int rowEnd) {
+    horizontalRows(kernel, radius, border, input, output, width, rowBegin, rowEnd, [&](const RGBA *center) {
+        return convolvePixelInterior(kernel, radius, center, 1);
+    });
+}
+
+void convolveRowsVerticalGeneric(const float *kernel, int radius, BorderMode border, const RGBA *input, RGBA *output,
+                                 int width, int height, int rowBegin, int rowEnd) {
+    verticalRows(kernel, radius, border, input, output, width, height, rowBegin, rowEnd, [&](const RGBA *center) {
+        return convolvePixelInterior(kernel, radius, center, width);
+    });
+}
+
+template <int R>
+void convolveRowsHorizontal(const float *kernelPtr, int, BorderMode border, const RGBA *input, RGBA *output,
+                            int width, int, int rowBegin, int rowEnd) {
+    std::array<float, 2 * R + 1> kernel;
+    std::copy(kernelPtr, kernelPtr + kernel.size(), kernel.begin());
+
+    horizontalRows(kernelPtr, R, border, input, output, width, rowBegin, rowEnd, [&](const RGBA *center) {
+        return convolvePixelUnrolled<R>(kernel, center, 1, std::make_index_sequence<2 * R + 1>{});
+    });
+}
+
+template <int R>
+void convolveRowsVertical(const float *kernelPtr, int, BorderMode border, const RGBA *input, RGBA *output,
+                          int width, int height, int rowBegin, int rowEnd) {
+    std::array<float, 2 * R + 1> kernel;
+    std::copy(kernelPtr, kernelPtr + kernel.size(), kernel.begin());
+
+    verticalRows(kernelPtr, R, border, input, output, width, height, rowBegin, rowEnd, [&](const RGBA *center) {
+        return convolvePixelUnrolled<R>(kernel, center, width, std::make_index_sequence<2 * R + 1>{});
+    });
+}
+
+template <std::size_t... R>
+constexpr std::array<ConvolveRowsFn, sizeof...(R) + 1> makeHorizontalTable(std::index_sequence<R...>) {
+    return {&convolveRowsHorizontalGeneric, &convolveRowsHorizontal<int(R) + 1>...};
+}
+
+template <std::size_t... R>
+constexpr std::array<ConvolveRowsFn, sizeof...(R) + 1> makeVerticalTable(std::index_sequence<R...>) {
+    return {&convolveRowsVerticalGeneric, &convolveRowsVertical<int(R) + 1>...};
+}
+
+// Indexed by radius; slot 0 holds the generic routine
+constexpr auto HORIZONTAL_TABLE = makeHorizontalTable(std::make_index_sequence<MAX_SPECIALIZED_RADIUS>{});
+constexpr auto VERTICAL_TABLE = makeVerticalTable(std::make_index_sequence<MAX_SPECIALIZED_RADIUS>{});
+
+template <std::size_t... R>
+constexpr auto makeGaussianTable(std::index_sequence<R...>) {
+    return std::make_tuple(gaussianKernel<int(R) + 1>()...);
+}
+
+constexpr auto GAUSSIAN_KERNELS = makeGaussianTable(std::make_index_sequence<MAX_SPECIALIZED_RADIUS>{});
+
+template <std::size_t... R>
+std::span<const float> gaussianAt(int radius, std::index_sequence<R...>) {
+    std::span<const float> found;
+    ((radius == int(R) + 1 ? (found = std::get<R>(GAUSSIAN_KERNELS), 0) : 0), ...);
+    return found;
+}
+
+// Shifts a fixed-point accumulator back to a channel value, rounding to nearest
+inline std::uint8_t fixedToChannel(std::int64_t acc, int shift) {
+    std::int64_t rounding = shift > 0 ? std::int64_t(1) << (shift - 1) : 0;
+    std::int64_t value = (acc + rounding) >> shift;
+    return static_cast<std::uint8_t>(std::clamp<std::int64_t>(value, 0, 255));
+}
+
+// Rescales an accumulator for BORDER_ZERO_RENORMALIZED; used and total are
+// weight sums in the kernel's fixed-point units
+inline std::int64_t renormalizeFixed(std::int32_t acc, std::int32_t used, std::int32_t total) {
+    return used == 0 ? acc : std::int64_t(acc) * total / used;
+}
+
+} // namespace
+
+ConvolveRowsFn horizontalConvolver(int radius) {
+    return radius >= 1 && radius <= MAX_SPECIALIZED_RADIUS ? HORIZONTAL_TABLE[radius] : HORIZONTAL_TABLE[0];
+}
+
+ConvolveRowsFn verticalConvolver(int radius) {
+    return radius >= 1 && radius <= MAX_SPECIALIZED_RADIUS ? VERTICAL_TABLE[radius] : VERTICAL_TABLE[0];
+}
+
+/**
+ * FIXED POINT
+ */
+
+constexpr int MAX_FIXED_SHIFT = 14;
+
+FixedPointKernel quantizeKernel(std::span<const float> kernel) {
+    // the passes read weights [0, 2 * (size / 2)], one past the end of an even kernel
+    assert(kernel.size() % 2 == 1 && "kernels have a centre tap");
+    FixedPointKernel fixed;
+
+    // the largest shift that keeps every weight in int16 and every
+    // 255 * sum(|weight|) accumulation in int32
+    double maxAbs = 0.0;
+    double sumAbs = 0.0;
+    double sum = 0.0;
+    for (float weight : kernel) {
+        maxAbs = std::max(maxAbs, double(std::fabs(weight)));
+        sumAbs += std::fabs(weight);
+        sum += weight;
+    }
+    fixed.shift = MAX_FIXED_SHIFT;
+    while (fixed.shift > 0 && (maxAbs * (1 << fixed.shift) > INT16_MAX ||
+                               255.0 * sumAbs * (1 << fixed.shift) > INT32_MAX / 2)) {
+        fixed.shift--;
+    }
+
+    double scale = double(1 << fixed.shift);
+    std::vector<double> residuals(kernel.size());
+    std::int64_t quantizedSum = 0;
+    fixed.weights.resize(kernel.size());
+    for (size_t i = 0; i < kernel.size(); i++) {
+        double exact = kernel[i] * scale;
+        fixed.weights[i] = static_cast<std::int16_t>(std::lround(exact));
+        residuals[i] = exact - fixed.weights[i];
+        quantizedSum += fixed.weights[i];
+    }
+
+    // hand the rounding deficit to the taps that were rounded the furthest
+    std::int64_t deficit = std::llround(sum * scale) - quantizedSum;
+    while (deficit != 0) {
+        int step = deficit > 0 ? 1 : -1;
+        size_t best = 0;
+        for (size_t i = 1; i < residuals.size(); i++) {
+            if (residuals[i] * step > residuals[best] * step) {
+                best = i;
+            }
+        }
+        fixed.weights[best] += step;
+        residuals[best] -= step;
+        deficit -= step;
+    }
+
+    return fixed;
+}
+
+void convolveRowsHorizontalFixed(const FixedPointKernel &kernel, BorderMode border, const RGBA *input, RGBA *output,
+                                 int width, int, int rowBegin, int rowEnd) {
+    int radius = static_cast<int>(kernel.weights.size()) / 2;
+    const std::int16_t *weights = kernel.weights.data();
+    std::int32_t kernelSum = 0;
+    for (std::int16_t weight : kernel.weights) {
+        kernelSum += weight;
+    }
+    bool renormalize = border == BORDER_ZERO_RENORMALIZED && kernelSum != 0;
+
+    int interiorBegin = std::min(radius, width);
+    int interiorEnd = std::max(interiorBegin, width - radius);
+
+    auto borderPixel = [&](const RGBA *rowIn, int c) {
+        std::int32_t redAcc = 0;
+        std::int32_t greenAcc = 0;
+        std::int32_t blueAcc = 0;
+        std::int32_t usedWeight = 0;
+
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(c + k, width, border);
+            if (index < 0) {
+                continue;
+            }
+            const RGBA &pixel = rowIn[index];
+            std::int32_t weight = weights[k + radius];
+            redAcc += weight * pixel.r;
+            greenAcc += weight * pixel.g;
+            blueAcc += weight * pixel.b;
+            usedWeight += weight;
+        }
+
+        if (renormalize) {
+            return RGBA{fixedToChannel(renormalizeFixed(redAcc, usedWeight, kernelSum), kernel.shift),
+                        fixedToChannel(renormalizeFixed(greenAcc, usedWeight, kernelSum), kernel.shift),
+                        fixedToChannel(renormalizeFixed(blueAcc, usedWeight, kernelSum), kernel.shift), 255};
+        }
+        return RGBA{fixedToChannel(redAcc, kernel.shift), fixedToChannel(greenAcc, kernel.shift),
+                    fixedToChannel(blueAcc, kernel.shift), 255};
+    };
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const RGBA *rowIn = input + size_t(r) * width;
+        RGBA *rowOut = output + size_t(r) * width;
+
+        for (int c = 0; c < interiorBegin; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+        for (int c = interiorBegin; c < interiorEnd; c++) {
+            std::int32_t redAcc = 0;
+            std::int32_t greenAcc = 0;
+            std::int32_t blueAcc = 0;
+
+            for (int k = -radius; k <= radius; k++) {
+                const RGBA &pixel = rowIn[c + k];
+                std::int32_t weight = weights[k + radius];
+                redAcc += weight * pixel.r;
+                greenAcc += weight * pixel.g;
+                blueAcc += weight * pixel.b;
+            }
+
+            rowOut[c] = RGBA{fixedToChannel(redAcc, kernel.shift), fixedToChannel(greenAcc, kernel.shift),
+                             fixedToChannel(blueAcc, kernel.shift), 255};
+        }
+        for (int c = interiorEnd; c < width; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+    }
+}
+
+// Accumulates whole source rows into an int32 row so the inner loop runs over
+// contiguous channels with no per-tap bounds checks, which vectorizes well.
+// Border rows only differ in which source rows their taps resolve to.
+void convolveRowsVerticalFixed(const FixedPointKernel &kernel, BorderMode border, const RGBA *input, RGBA *output,
+                               int width, int height, int rowBegin, int rowEnd) {
+    int radius = static_cast<int>(kernel.weights.size()) / 2;
+    std::int32_t kernelSum = 0;
+    for (std::int16_t weight : kernel.weights) {
+        kernelSum += weight;
+    }
+    // per-thread scratch row; only grows, so steady state does no allocation
+    thread_local std::vector<std::int32_t> accRow;
+    if (accRow.size() < size_t(width) * 4) {
+        accRow.resize(size_t(width) * 4);
+    }
+    std::int32_t *acc = accRow.data();
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        std::fill(acc, acc + size_t(width) * 4, 0);
+        std::int32_t usedWeight = 0;
+
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(r + k, height, border);
+            if (index < 0) {
+                continue;
+            }
+            const std::uint8_t *rowIn = reinterpret_cast<const std::uint8_t *>(input + size_t(index) * width);
+            std::int32_t weight = kernel.weights[k + radius];
+            usedWeight += weight;
+            for (int i = 0; i < width * 4; i++) {
+                acc[i] += weight * rowIn[i];
+            }
+        }
+
+        RGBA *rowOut = output + size_t(r) * width;
+        if (border == BORDER_ZERO_RENORMALIZED && kernelSum != 0 && usedWeight != kernelSum) {
+            for (int c = 0; c < width; c++) {
+                rowOut[c] = RGBA{fixedToChannel(renormalizeFixed(acc[4 * c], usedWeight, kernelSum), kernel.shift),
+                                 fixedToChannel(renormalizeFixed(acc[4 * c + 1], usedWeight, kernelSum), kernel.shift),
+                                 fixedToChannel(renormalizeFixed(acc[4 * c + 2], usedWeight, kernelSum), kernel.shift), 255};
+            }
+            continue;
+        }
+        for (int c = 0; c < width; c++) {
+            rowOut[c] = RGBA{fixedToChannel(acc[4 * c], kernel.shift), fixedToChannel(acc[4 * c + 1], kernel.shift),
+                             fixedToChannel(acc[4 * c + 2], kernel.shift), 255};
+        }
+    }
+}
+
+/**
+ * GRAY
+ */
+
+void convolveGrayRowsHorizontal(const float *kernel, int radius, BorderMode border, const std::uint8_t *input,
+                                std::uint8_t *output, int width, int, int rowBegin, int rowEnd) {
+    float kernelSum = kernelSumOf(kernel, radius);
+    int interiorBegin = std::min(radius, width);
+    int interiorEnd = std::max(interiorBegin, width - radius);
+
+    auto borderPixel = [&](const std::uint8_t *rowIn, int c) {
+        float acc = 0.0f;
+        float usedWeight = 0.0f;
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(c + k, width, border);
+            if (index < 0) {
+                continue;
+            }
+            acc += kernel[k + radius] * rowIn[index];
+            usedWeight += kernel[k + radius];
+        }
+        if (border == BORDER_ZERO_RENORMALIZED && canRenormalize(kernelSum) && canRenormalize(usedWeight)) {
+            acc *= kernelSum / usedWeight;
+        }
+        return clamp(acc);
+    };
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const std::uint8_t *rowIn = input + size_t(r) * width;
+        std::uint8_t *rowOut = output + size_t(r) * width;
+
+        for (int c = 0; c < interiorBegin; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+        for (int c = interiorBegin; c < interiorEnd; c++) {
+            float acc = 0.0f;
+            for (int k = -radius; k <= radius; k++) {
+                acc += kernel[k + radius] * rowIn[c + k];
+            }
+            rowOut[c] = clamp(acc);
+        }
+        for (int c = interiorEnd; c < width; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+    }
+}
+
+// Accumulates whole source rows tap by tap; each pixel still sums its taps in
+// kernel order, as the RGBA routine does
+void convolveGrayRowsVertical(const float *kernel, int radius, BorderMode border, const std::uint8_t *input,
+                              std::uint8_t *output, int width, int height, int rowBegin, int rowEnd) {
+    float kernelSum = kernelSumOf(kernel, radius);
+    thread_local std::vector<float> accRow;
+    accRow.resize(width);
+    float *acc = accRow.data();
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        std::fill(acc, acc + width, 0.0f);
+        float usedWeight = 0.0f;
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(r + k, height, border);
+            if (index < 0) {
+                continue;
+            }
+            const std::uint8_t *rowIn = input + size_t(index) * width;
+            float weight = kernel[k + radius];
+            usedWeight += weight;
+            for (int c = 0; c < width; c++) {
+                acc[c] += weight * rowIn[c];
+            }
+        }
+
+        std::uint8_t *rowOut = output + size_t(r) * width;
+        bool borderRow = r < radius || r >= height - radius;
+        if (borderRow && border == BORDER_ZERO_RENORMALIZED && canRenormalize(kernelSum) && canRenormalize(usedWeight)) {
+            float scale = kernelSum / usedWeight;
+            if (scale != 1.0f) {
+                for (int c = 0; c < width; c++) {
+                    acc[c] *= scale;
+                }
+            }
+        }
+        for (int c = 0; c < width; c++) {
+            rowOut[c] = clamp(acc[c]);
+        }
+    }
+}
+
+void convolveGrayRowsHorizontalFixed(const FixedPointKernel &kernel, BorderMode border, const std::uint8_t *input,
+                                     std::uint8_t *output, int width, int, int rowBegin, int rowEnd) {
+    int radius = static_cast<int>(kernel.weights.size()) / 2;
+    const std::int16_t *weights = kernel.weights.data();
+    std::int32_t kernelSum = 0;
+    for (std::int16_t weight : kernel.weights) {
+        kernelSum += weight;
+    }
+    bool renormalize = border == BORDER_ZERO_RENORMALIZED && kernelSum != 0;
+
+    int interiorBegin = std::min(radius, width);
+    int interiorEnd = std::max(interiorBegin, width - radius);
+
+    auto borderPixel = [&](const std::uint8_t *rowIn, int c) {
+        std::int32_t acc = 0;
+        std::int32_t usedWeight = 0;
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(c + k, width, border);
+            if (index < 0) {
+                continue;
+            }
+            acc += std::int32_t(weights[k + radius]) * rowIn[index];
+            usedWeight += weights[k + radius];
+        }
+        return fixedToChannel(renormalize ? renormalizeFixed(acc, usedWeight, kernelSum) : acc, kernel.shift);
+    };
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        const std::uint8_t *rowIn = input + size_t(r) * width;
+        std::uint8_t *rowOut = output + size_t(r) * width;
+
+        for (int c = 0; c < interiorBegin; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+        for (int c = interiorBegin; c < interiorEnd; c++) {
+            std::int32_t acc = 0;
+            for (int k = -radius; k <= radius; k++) {
+                acc += std::int32_t(weights[k + radius]) * rowIn[c + k];
+            }
+            rowOut[c] = fixedToChannel(acc, kernel.shift);
+        }
+        for (int c = interiorEnd; c < width; c++) {
+            rowOut[c] = borderPixel(rowIn, c);
+        }
+    }
+}
+
+void convolveGrayRowsVerticalFixed(const FixedPointKernel &kernel, BorderMode border, const std::uint8_t *input,
+                                   std::uint8_t *output, int width, int height, int rowBegin, int rowEnd) {
+    int radius = static_cast<int>(kernel.weights.size()) / 2;
+    std::int32_t kernelSum = 0;
+    for (std::int16_t weight : kernel.weights) {
+        kernelSum += weight;
+    }
+    thread_local std::vector<std::int32_t> accRow;
+    accRow.resize(width);
+    std::int32_t *acc = accRow.data();
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+        std::fill(acc, acc + width, 0);
+        std::int32_t usedWeight = 0;
+        for (int k = -radius; k <= radius; k++) {
+            int index = borderIndex(r + k, height, border);
+            if (index < 0) {
+                continue;
+            }
+            const std::uint8_t *rowIn = input + size_t(index) * width;
+            std::int32_t weight = kernel.weights[k + radius];
+            usedWeight += weight;
+            for (int c = 0; c < width; c++) {
+                acc[c] += weight * rowIn[c];
+            }
+        }
+
+        std::uint8_t *rowOut = output + size_t(r) * width;
+        bool renormalize = border == BORDER_ZERO_RENORMALIZED && kernelSum != 0 && usedWeight != kernelSum;
+        for (int c = 0; c < width; c++) {
+            rowOut[c] = fixedToChannel(renormalize ? renormalizeFixed(acc[c], usedWeight, kernelSum) : acc[c], kernel.shift);
+        }
+    }
+}
+
+std::span<const float> fixedGaussianKernel(int radius) {
+    return gaussianAt(radius, std::make_index_sequence<MAX_SPECIALIZED_RADIUS>{});
+}
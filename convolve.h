@@ -0,0 +1,175 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * Row-level 1D convolution routines used by the filter passes.
+ *
+ * Each routine convolves rows [rowBegin, rowEnd) of a width x height image with
+ * an odd-length kernel of 2 * radius + 1 taps, writing r, g, b into output and
+ * setting alpha to 255. Taps that fall outside the image are handled according
+ * to a BorderMode.
+ *
+ * Every pass is split into a border region (the radius-wide columns or rows at
+ * each edge) and the interior. Only border pixels ever look at the border mode;
+ * interior loops have no bounds checks at all. Vertical passes resolve the
+ * source row of each tap once per border row, so even their border rows run
+ * branch-free across the width.
+ *
+ * Kernels with radius 1 to MAX_SPECIALIZED_RADIUS get routines specialized at
+ * compile time with the interior tap loop fully unrolled. Larger kernels use
+ * the generic routine.
+ */
+
+// How taps that fall outside the image are treated
+enum BorderMode {
+    BORDER_ZERO,                // treated as black (skipped), which darkens edges
+    BORDER_CLAMP,               // repeat the edge pixel: ...A,A,A,B,C,D,D,D...
+    BORDER_MIRROR,              // reflect about the edge pixel: ...C,B,A,B,C,D,C,B...
+    BORDER_WRAP,                // tile the image: ...C,D,A,B,C,D,A,B...
+    BORDER_ZERO_RENORMALIZED,   // skipped, with the remaining taps rescaled to the full kernel sum
+    NUM_BORDER_MODES
+};
+
+// Maps a tap position outside [0, limit) back into it, or returns -1 if the
+// tap contributes nothing
+int borderIndex(int index, int limit, BorderMode border);
+
+using ConvolveRowsFn = void (*)(const float *kernel, int radius, BorderMode border, const RGBA *input, RGBA *output,
+                                int width, int height, int rowBegin, int rowEnd);
+
+constexpr int MAX_SPECIALIZED_RADIUS = 8;
+
+// Returns the specialized routine for radius if there is one, else the generic one
+ConvolveRowsFn horizontalConvolver(int radius);
+ConvolveRowsFn verticalConvolver(int radius);
+
+// Per-filter choices that apply to every convolution pass of that filter
+struct ConvolveOptions {
+    bool fixedPoint = false;            // use the integer path below instead of float
+    BorderMode border = BORDER_ZERO;
+    bool linearLight = false;           // convolve in linear light, see srgb.h; overrides fixedPoint
+};
+
+/**
+ * FIXED POINT
+ *
+ * The integer path quantizes a kernel to 16-bit weights in units of 2^-shift
+ * and accumulates uint8 x int16 products in int32, rounding once at the end.
+ * Rounding is done by largest remainder, so the quantized weights always sum
+ * to exactly round(sum * 2^shift): a normalized kernel stays normalized and
+ * flat regions come out unchanged.
+ *
+ * Maximum error versus the float path: each weight is off by less than one
+ * unit, so a pass differs by less than 255 * taps / 2^shift levels before the
+ * final rounding. For normalized kernels (shift 14) of up to 63 taps (radius
+ * 31) that is below one level, i.e. every channel is within +-1 of the float
+ * result per pass. Larger kernels may drift further in the worst case, by up
+ * to ceil(255 * taps / 16384) levels.
+ */
+
+struct FixedPointKernel {
+    std::vector<std::int16_t> weights;
+    int shift = 0;
+};
+
+// kernel must have an odd number of taps
+FixedPointKernel quantizeKernel(std::span<const float> kernel);
+
+void convolveRowsHorizontalFixed(const FixedPointKernel &kernel, BorderMode border, const RGBA *input, RGBA *output,
+                                 int width, int height, int rowBegin, int rowEnd);
+void convolveRowsVerticalFixed(const FixedPointKernel &kernel, BorderMode border, const RGBA *input, RGBA *output,
+                               int width, int height, int rowBegin, int rowEnd);
+
+/**
+ * GRAY
+ *
+ * Single-channel versions of the routines above for 8-bit luminance planes
+ * (GrayImage, see filter.h). Each output byte is computed exactly as the RGBA
+ * routines compute one channel, so a gray pipeline gives the same result as
+ * running the RGBA one on an image with r = g = b, in a quarter of the memory.
+ */
+
+void convolveGrayRowsHorizontal(const float *kernel, int radius, BorderMode border, const std::uint8_t *input,
+                                std::uint8_t *output, int width, int height, int rowBegin, int rowEnd);
+void convolveGrayRowsVertical(const float *kernel, int radius, BorderMode border, const std::uint8_t *input,
+                              std::uint8_t *output, int width, int height, int rowBegin, int rowEnd);
+void convolveGrayRowsHorizontalFixed(const FixedPointKernel &kernel, BorderMode border, const std::uint8_t *input,
+                                     std::uint8_t *output, int width, int height, int rowBegin, int rowEnd);
+void convolveGrayRowsVerticalFixed(const FixedPointKernel &kernel, BorderMode border, const std::uint8_t *input,
+                                   std::uint8_t *output, int width, int height, int rowBegin, int rowEnd);
+
+/**
+ * CONSTANT KERNELS
+ */
+
+// Separable Sobel factors: the derivative [-1 0 1] and the smoothing [1 2 1]
+constexpr std::array<float, 3> SOBEL_DERIVATIVE = {-1.0f, 0.0f, 1.0f};
+constexpr std::array<float, 3> SOBEL_SMOOTH = {1.0f, 2.0f, 1.0f};
+
+namespace constexpr_math {
+
+constexpr double LN2 = 0.693147180559945309417232121458;
+
+// exp(x) via x = n ln2 + r, |r| <= ln2 / 2, and a Taylor series for exp(r)
+constexpr double exp(double x) {
+    int n = static_cast<int>(x / LN2 + (x < 0 ? -0.5 : 0.5));
+    double r = x - n * LN2;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int i = 1; i < 30; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (; n > 0; n--) sum *= 2.0;
+    for (; n < 0; n++) sum *= 0.5;
+    return sum;
+}
+
+// Newton's method, started from x itself
+constexpr double sqrt(double x) {
+    if (x <= 0) return 0;
+    double guess = x < 1 ? 1 : x;
+    for (int i = 0; i < 100; i++) {
+        double next = 0.5 * (guess + x / guess);
+        if (next == guess) break;
+        guess = next;
+    }
+    return guess;
+}
+
+} // namespace constexpr_math
+
+/**
+ * @brief Normalized Gaussian of radius R with standard deviation R / 3, computed
+ * the same way filterBlur computes its runtime kernel
+ */
+template <int R>
+constexpr std::array<float, 2 * R + 1> gaussianKernel() {
+    std::array<float, 2 * R + 1> kernel{};
+    double stddev = static_cast<float>(R / 3.0);
+    double sum = 0.0;
+    for (int i = 0; i < 2 * R + 1; i++) {
+        int dx = i - R;
+        double value = (1 / constexpr_math::sqrt(2 * M_PI * (stddev * stddev))) *
+                       constexpr_math::exp(-((dx * dx) / (2 * (stddev * stddev))));
+        kernel[i] = value;
+        sum += value;
+    }
+    for (int i = 0; i < 2 * R + 1; i++) {
+        kernel[i] /= sum;
+    }
+    return kernel;
+}
+
+// The precomputed Gaussian for radius, or an empty span if radius is larger
+// than MAX_SPECIALIZED_RADIUS
+std::span<const float> fixedGaussianKernel(int radius);
+
+#endif // CONVOLVE_H
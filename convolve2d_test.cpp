@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include "fft.h"
+#include "filter.h"
+#include "kernels.h"
+#include "separable.h"
+
+/**
+ * Checks the fast 2D convolution paths against convolve2DDirect for every
+ * border mode: the FFT path on kernels of any shape, and the separable path on
+ * a single-term kernel (two ordinary 1D passes) and on a two-term kernel with
+ * negative weights (the fused pass). Returns non-zero if any result differs by
+ * more than the path allows.
+ */
+
+namespace {
+
+constexpr int TEST_WIDTH = 157;
+constexpr int TEST_HEIGHT = 103;
+
+// Error the separable approximations may add, in levels, as convolve2D allows
+constexpr float SEPARABLE_TOLERANCE = 0.5f;
+
+// Largest difference of any channel of any pixel, in levels
+int maxDifference(const std::vector<RGBA> &a, const std::vector<RGBA> &b) {
+    int largest = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        largest = std::max({largest, std::abs(a[i].r - b[i].r), std::abs(a[i].g - b[i].g),
+                            std::abs(a[i].b - b[i].b), std::abs(a[i].a - b[i].a)});
+    }
+    return largest;
+}
+
+// A line of length 2 * radius + 1 through the centre, antialiased, as motion
+// blur smears along; separable only along the axes
+std::vector<float> lineKernel(int radius, float angleDegrees) {
+    int kernelLen = 2 * radius + 1;
+    float angle = angleDegrees * float(M_PI) / 180.0f;
+    float dx = std::cos(angle);
+    float dy = -std::sin(angle);
+    std::vector<float> kernel(kernelLen * kernelLen);
+    float sum = 0.0f;
+    for (int kr = 0; kr < kernelLen; kr++) {
+        for (int kc = 0; kc < kernelLen; kc++) {
+            float x = float(kc - radius);
+            float y = float(kr - radius);
+            float along = std::clamp(x * dx + y * dy, -float(radius), float(radius));
+            float weight = std::max(0.0f, 1.0f - std::hypot(x - along * dx, y - along * dy));
+            kernel[kr * kernelLen + kc] = weight;
+            sum += weight;
+        }
+    }
+    for (float &weight : kernel) {
+        weight /= sum;
+    }
+    return kernel;
+}
+
+// The outer product of the cached Gaussian with itself, scaled by -amount,
+// plus 1 + amount at the centre: unsharp masking, exactly two separable terms
+std::vector<float> unsharpKernel(int radius, float amount) {
+    std::span<const float> gaussian = cachedKernel(KERNEL_GAUSSIAN, radius).taps();
+    int kernelLen = 2 * radius + 1;
+    std::vector<float> kernel(kernelLen * kernelLen);
+    for (int kr = 0; kr < kernelLen; kr++) {
+        for (int kc = 0; kc < kernelLen; kc++) {
+            kernel[kr * kernelLen + kc] = -amount * gaussian[kr] * gaussian[kc];
+        }
+    }
+    kernel[radius * kernelLen + radius] += 1.0f + amount;
+    return kernel;
+}
+
+// The outer product of the cached Gaussian with itself; one separable term
+std::vector<float> gaussianKernel(int radius) {
+    std::span<const float> gaussian = cachedKernel(KERNEL_GAUSSIAN, radius).taps();
+    int kernelLen = 2 * radius + 1;
+    std::vector<float> kernel(kernelLen * kernelLen);
+    for (int kr = 0; kr < kernelLen; kr++) {
+        for (int kc = 0; kc < kernelLen; kc++) {
+            kernel[kr * kernelLen + kc] = gaussian[kr] * gaussian[kc];
+        }
+    }
+    return kernel;
+}
+
+bool check(const std::string &name, int difference, int allowed) {
+    if (difference > allowed) {
+        std::cout << "FAIL " << name << ": differs from direct by " << difference << " levels, allowed "
+                  << allowed << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 random(1);
+    Image image{TEST_WIDTH, TEST_HEIGHT, std::vector<RGBA>(TEST_WIDTH * TEST_HEIGHT)};
+    for (RGBA &pixel : image.data) {
+        pixel = RGBA{std::uint8_t(random()), std::uint8_t(random()), std::uint8_t(random()), std::uint8_t(random())};
+    }
+
+    bool passed = true;
+    for (int border = 0; border < NUM_BORDER_MODES; border++) {
+        ConvolveOptions options;
+        options.border = static_cast<BorderMode>(border);
+        std::string mode = " border " + std::to_string(border);
+
+        // the FFT path, to within one level of rounding
+        for (int radius : {3, 9, 20}) {
+            for (float angle : {0.0f, 30.0f, 90.0f}) {
+                std::vector<float> kernel = lineKernel(radius, angle);
+                std::vector<RGBA> direct;
+                std::vector<RGBA> fft;
+                FilterProgress progress;
+                convolve2DDirect(kernel, image, direct, options, progress);
+                convolve2DFFT(kernel, image, fft, options, progress);
+                passed &= check("fft line radius " + std::to_string(radius) + " angle " + std::to_string(angle) + mode,
+                                maxDifference(direct, fft), 1);
+            }
+        }
+
+        // the separable path, to within its error bound plus rounding
+        for (int radius : {3, 8}) {
+            for (bool fused : {false, true}) {
+                std::vector<float> kernel = fused ? unsharpKernel(radius, 1.5f) : gaussianKernel(radius);
+                int kernelLen = 2 * radius + 1;
+                SeparableKernel separable = separateKernel(kernel, SEPARABLE_TOLERANCE, maxSeparableTerms(kernelLen));
+                std::string name = (fused ? "fused unsharp radius " : "two-pass gaussian radius ") +
+                                   std::to_string(radius) + mode;
+                if (separable.terms.size() != (fused ? 2u : 1u)) {
+                    std::cout << "FAIL " << name << ": decomposed into " << separable.terms.size() << " terms"
+                              << std::endl;
+                    passed = false;
+                    continue;
+                }
+                std::vector<RGBA> direct;
+                std::vector<RGBA> result;
+                FilterProgress progress;
+                convolve2DDirect(kernel, image, direct, options, progress);
+                convolveSeparable(separable, image, result, options, progress);
+                passed &= check(name, maxDifference(direct, result), static_cast<int>(std::ceil(separable.errorBound)) + 1);
+            }
+        }
+    }
+
+    std::cout << (passed ? "PASS" : "FAIL") << std::endl;
+    return passed ? 0 : 1;
+}
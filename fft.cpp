@@ -0,0 +1,287 @@
+#include "fft.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include "threadpool.h"
+#include "trace.h"
+
+using Complex = std::complex<float>;
+
+// std::complex's operator* checks for NaN and infinity on every product
+static inline Complex multiply(Complex a, Complex b) {
+    return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+FFT::FFT(int size) : m_size(size), m_bitReverse(size), m_twiddles(size / 2) {
+    int bits = std::countr_zero(static_cast<unsigned>(size));
+    for (int i = 0; i < size; i++) {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; bit++) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        m_bitReverse[i] = reversed;
+    }
+    for (int k = 0; k < size / 2; k++) {
+        double angle = -2.0 * M_PI * k / size;
+        m_twiddles[k] = Complex(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+    }
+}
+
+void FFT::transform(Complex *data, bool inverse) const {
+    for (int i = 0; i < m_size; i++) {
+        int j = m_bitReverse[i];
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    for (int length = 2; length <= m_size; length *= 2) {
+        int half = length / 2;
+        int stride = m_size / length;
+        for (int start = 0; start < m_size; start += length) {
+            for (int k = 0; k < half; k++) {
+                Complex twiddle = m_twiddles[k * stride];
+                if (inverse) {
+                    twiddle = std::conj(twiddle);
+                }
+                Complex even = data[start + k];
+                Complex odd = multiply(data[start + k + half], twiddle);
+                data[start + k] = even + odd;
+                data[start + k + half] = even - odd;
+            }
+        }
+    }
+}
+
+void FFT::transform2D(Complex *data, bool inverse) const {
+    // rows, transpose, rows: the inverse runs the same steps in the same order
+    for (int row = 0; row < m_size; row++) {
+        transform(data + size_t(row) * m_size, inverse);
+    }
+    for (int row = 0; row < m_size; row++) {
+        for (int col = row + 1; col < m_size; col++) {
+            std::swap(data[size_t(row) * m_size + col], data[size_t(col) * m_size + row]);
+        }
+    }
+    for (int row = 0; row < m_size; row++) {
+        transform(data + size_t(row) * m_size, inverse);
+    }
+}
+
+/**
+ * TILED CONVOLUTION
+ */
+
+constexpr int MIN_FFT_TILE = 32;
+constexpr int MAX_FFT_TILE = 1024;
+
+// Overlap-save with tileSize x tileSize tiles; see fft.h
+static void convolveTiles(std::span<const float> kernel, const Image &image, std::vector<RGBA> &result,
+                          const ConvolveOptions &options, FilterProgress &progress, int tileSize) {
+    TRACE_SCOPE("convolve2DFFT");
+    result.resize(image.data.size());
+
+    int kernelLen = std::sqrt(kernel.size());
+    int kernelOffset = kernelLen / 2;
+    int block = tileSize - kernelLen + 1;
+    float kernelSum = 0.0f;
+    for (float weight : kernel) {
+        kernelSum += weight;
+    }
+    bool renormalize = options.border == BORDER_ZERO_RENORMALIZED && std::fabs(kernelSum) > 1e-6f;
+
+    // spectrum of the flipped kernel (convolve2D correlates), with the inverse
+    // transform's 1 / tileSize^2 folded in
+    FFT fft(tileSize);
+    float scale = 1.0f / (float(tileSize) * tileSize);
+    std::vector<Complex> spectrum(size_t(tileSize) * tileSize);
+    for (int kr = 0; kr < kernelLen; kr++) {
+        for (int kc = 0; kc < kernelLen; kc++) {
+            spectrum[size_t(kernelLen - 1 - kr) * tileSize + (kernelLen - 1 - kc)] = kernel[kr * kernelLen + kc] * scale;
+        }
+    }
+    fft.transform2D(spectrum.data(), false);
+
+    int tilesX = (image.width + block - 1) / block;
+    int tilesY = (image.height + block - 1) / block;
+    int tiles = tilesX * tilesY;
+    int strips = stripCount(image.height);
+    std::atomic<int> tilesDone = 0;
+
+    ThreadPool::instance().parallelFor(0, tiles, [&](int tile) {
+        if (progress.isCancelled()) {
+            return;
+        }
+        thread_local std::vector<Complex> redGreen;
+        thread_local std::vector<Complex> blueMask;
+        thread_local std::vector<int> sourceColumns;
+        redGreen.assign(size_t(tileSize) * tileSize, Complex());
+        blueMask.assign(size_t(tileSize) * tileSize, Complex());
+
+        int blockX = (tile % tilesX) * block;
+        int blockY = (tile / tilesX) * block;
+        int blockWidth = std::min(block, image.width - blockX);
+        int blockHeight = std::min(block, image.height - blockY);
+
+        // the block's input footprint; the rest of the tile stays zero and only
+        // affects the discarded wrap-around outputs
+        int footprintWidth = blockWidth + kernelLen - 1;
+        int footprintHeight = blockHeight + kernelLen - 1;
+        sourceColumns.resize(footprintWidth);
+        for (int tx = 0; tx < footprintWidth; tx++) {
+            sourceColumns[tx] = borderIndex(blockX - kernelOffset + tx, image.width, options.border);
+        }
+        for (int ty = 0; ty < footprintHeight; ty++) {
+            int y = borderIndex(blockY - kernelOffset + ty, image.height, options.border);
+            if (y < 0) {
+                continue;
+            }
+            const RGBA *sourceRow = &image.data[size_t(y) * image.width];
+            for (int tx = 0; tx < footprintWidth; tx++) {
+                int x = sourceColumns[tx];
+                if (x < 0) {
+                    continue;
+                }
+                const RGBA &pixel = sourceRow[x];
+                redGreen[size_t(ty) * tileSize + tx] = Complex(pixel.r, pixel.g);
+                blueMask[size_t(ty) * tileSize + tx] = Complex(pixel.b, 1.0f);
+            }
+        }
+
+        fft.transform2D(redGreen.data(), false);
+        fft.transform2D(blueMask.data(), false);
+        for (size_t i = 0; i < spectrum.size(); i++) {
+            redGreen[i] = multiply(redGreen[i], spectrum[i]);
+            blueMask[i] = multiply(blueMask[i], spectrum[i]);
+        }
+        fft.transform2D(redGreen.data(), true);
+        fft.transform2D(blueMask.data(), true);
+
+        for (int j = 0; j < blockHeight; j++) {
+            int r = blockY + j;
+            bool borderRow = r < kernelOffset || r >= image.height - kernelOffset;
+            for (int i = 0; i < blockWidth; i++) {
+                int c = blockX + i;
+                size_t index = size_t(kernelLen - 1 + j) * tileSize + (kernelLen - 1 + i);
+                float redAcc = redGreen[index].real();
+                float greenAcc = redGreen[index].imag();
+                float blueAcc = blueMask[index].real();
+                float usedWeight = blueMask[index].imag();
+
+                bool borderPixel = borderRow || c < kernelOffset || c >= image.width - kernelOffset;
+                if (renormalize && borderPixel && std::fabs(usedWeight) > 1e-6f) {
+                    float rescale = kernelSum / usedWeight;
+                    redAcc *= rescale;
+                    greenAcc *= rescale;
+                    blueAcc *= rescale;
+                }
+                result[size_t(r) * image.width + c] = RGBA{clamp(redAcc), clamp(greenAcc), clamp(blueAcc), 255};
+            }
+        }
+
+        // spread the strip count over the tiles so progress reads the same as the direct path
+        int done = tilesDone.fetch_add(1, std::memory_order_relaxed) + 1;
+        progress.stripsDone.fetch_add(done * strips / tiles - (done - 1) * strips / tiles, std::memory_order_relaxed);
+    });
+}
+
+// Relative cost of an FFT pass with tileSize tiles: tiles x size^2 log2(size)
+static double tiledCost(int kernelLen, int width, int height, int tileSize) {
+    int block = tileSize - kernelLen + 1;
+    double tiles = double((width + block - 1) / block) * ((height + block - 1) / block);
+    return tiles * double(tileSize) * tileSize * std::log2(tileSize);
+}
+
+// The power-of-two tile size with the lowest tiledCost, or 0 if the kernel is
+// too large for any tile
+static int bestTileSize(int kernelLen, int width, int height) {
+    int best = 0;
+    double bestCost = std::numeric_limits<double>::max();
+    // a tile below twice the kernel size spends most of its work on the overlap
+    int smallest = std::max(MIN_FFT_TILE, static_cast<int>(std::bit_ceil(static_cast<unsigned>(2 * kernelLen))));
+    for (int tileSize = smallest; tileSize <= MAX_FFT_TILE; tileSize *= 2) {
+        double cost = tiledCost(kernelLen, width, height, tileSize);
+        if (cost < bestCost) {
+            best = tileSize;
+            bestCost = cost;
+        }
+        // one tile already covers the image
+        if (tileSize - kernelLen + 1 >= std::max(width, height)) {
+            break;
+        }
+    }
+    return best;
+}
+
+void convolve2DFFT(std::span<const float> kernel, const Image &image, std::vector<RGBA> &output,
+                   const ConvolveOptions &options, FilterProgress &progress) {
+    int kernelLen = std::sqrt(kernel.size());
+    int tileSize = bestTileSize(kernelLen, image.width, image.height);
+    if (tileSize == 0) {
+        convolve2DDirect(kernel, image, output, options, progress);
+        return;
+    }
+    convolveTiles(kernel, image, output, options, progress, tileSize);
+}
+
+/**
+ * CROSSOVER
+ */
+
+// Measured seconds per unit of each path's cost model
+struct ConvolutionCosts {
+    double perDirectTap = 0.0;      // per pixel per kernel tap
+    double perFFTUnit = 0.0;        // per unit of tiledCost()
+};
+
+// Best of a few runs of each path on a small synthetic image
+static ConvolutionCosts measureConvolutionCosts() {
+    TRACE_SCOPE("measureConvolutionCosts");
+    constexpr int SIZE = 128;
+    constexpr int KERNEL_LEN = 15;
+    constexpr int TILE_SIZE = 64;
+    constexpr int RUNS = 3;
+
+    Image image{SIZE, SIZE, std::vector<RGBA>(SIZE * SIZE)};
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        image.data[i] = RGBA{std::uint8_t(i * 7), std::uint8_t(i * 13), std::uint8_t(i * 29), 255};
+    }
+    std::vector<float> kernel(KERNEL_LEN * KERNEL_LEN, 1.0f / (KERNEL_LEN * KERNEL_LEN));
+    std::vector<RGBA> output;
+    ConvolveOptions options;
+
+    auto bestOf = [&](auto run) {
+        double best = std::numeric_limits<double>::max();
+        for (int i = 0; i < RUNS; i++) {
+            FilterProgress progress;
+            auto start = std::chrono::steady_clock::now();
+            run(progress);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+
+    ConvolutionCosts costs;
+    double direct = bestOf([&](FilterProgress &progress) { convolve2DDirect(kernel, image, output, options, progress); });
+    costs.perDirectTap = direct / (double(SIZE) * SIZE * KERNEL_LEN * KERNEL_LEN);
+    double fft = bestOf([&](FilterProgress &progress) { convolveTiles(kernel, image, output, options, progress, TILE_SIZE); });
+    costs.perFFTUnit = fft / tiledCost(KERNEL_LEN, SIZE, SIZE, TILE_SIZE);
+    return costs;
+}
+
+bool preferFFTConvolution(int kernelLen, int width, int height) {
+    // small kernels are always faster direct; skip measuring for them
+    if (kernelLen < 7 || width <= 0 || height <= 0) {
+        return false;
+    }
+    int tileSize = bestTileSize(kernelLen, width, height);
+    if (tileSize == 0) {
+        return false;
+    }
+    static const ConvolutionCosts costs = measureConvolutionCosts();
+    double direct = costs.perDirectTap * width * height * kernelLen * kernelLen;
+    double fft = costs.perFFTUnit * tiledCost(kernelLen, width, height, tileSize);
+    return fft < direct;
+}
@@ -0,0 +1,60 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <span>
+#include <vector>
+#include "filter.h"
+
+/**
+ * @class FFT
+ *
+ * Iterative radix-2 complex FFT of one power-of-two size, with the bit
+ * reversal permutation and twiddle factors computed once up front. A plan is
+ * immutable after construction, so threads may share one.
+ *
+ * Inverse transforms are unscaled; callers divide by size (or size^2 in 2D)
+ * wherever it is cheapest, e.g. by folding it into a kernel spectrum.
+ */
+class FFT {
+public:
+    explicit FFT(int size);
+
+    int size() const { return m_size; }
+
+    // Transforms size values in place
+    void transform(std::complex<float> *data, bool inverse) const;
+
+    // Transforms a size x size row-major tile in place. The forward transform
+    // leaves the spectrum transposed, which saves a transpose each way;
+    // pointwise products of spectra made this way are still correct, and the
+    // inverse transform expects this layout and restores the natural one.
+    void transform2D(std::complex<float> *data, bool inverse) const;
+
+private:
+    int m_size;
+    std::vector<int> m_bitReverse;
+    std::vector<std::complex<float>> m_twiddles;   // e^(-2 pi i k / size) for k < size / 2
+};
+
+/**
+ * FFT CONVOLUTION
+ *
+ * convolve2DFFT computes the same result as convolve2DDirect (to within one
+ * level from float rounding) by overlap-save: the output is cut into square
+ * blocks, each block's input footprint (the block grown by the kernel radius,
+ * read through the border mode) is transformed as one tile, multiplied by the
+ * kernel spectrum and transformed back, and the wrapped-around part of the
+ * circular result is discarded. Tiles are independent and run on the pool.
+ *
+ * Red and green share one complex transform and blue another, whose imaginary
+ * part carries the in-image mask that BORDER_ZERO_RENORMALIZED needs.
+ */
+void convolve2DFFT(std::span<const float> kernel, const Image &image, std::vector<RGBA> &output,
+                   const ConvolveOptions &options, FilterProgress &progress);
+
+// True if the FFT path is expected to beat the direct one for a square kernel
+// of kernelLen taps per side. Both costs are measured once per process.
+bool preferFFTConvolution(int kernelLen, int width, int height);
+
+#endif // FFT_H
@@ -0,0 +1,724 @@
+#include "filter.h"
+#include <numeric>
+#include "canny.h"
+#include "convolve.h"
+#include "fft.h"
+#include "sat.h"
+#include "separable.h"
+#include "settings.h"
+#include "threadpool.h"
+#include "trace.h"
+
+/**
+ * FILTER FUNCTIONALITY
+ */
+
+int stripCount(int rows) {
+    return (rows + FILTER_STRIP_ROWS - 1) / FILTER_STRIP_ROWS;
+}
+
+bool forEachStrip(int rows, FilterProgress &progress, FunctionRef<void(int, int)> body) {
+    ThreadPool::instance().parallelFor(0, stripCount(rows), [&](int strip) {
+        if (progress.isCancelled()) {
+            return;
+        }
+        int rowBegin = strip * FILTER_STRIP_ROWS;
+        body(rowBegin, std::min(rowBegin + FILTER_STRIP_ROWS, rows));
+        progress.stripsDone.fetch_add(1, std::memory_order_relaxed);
+    });
+    return !progress.isCancelled();
+}
+
+// Repeats the pixel on the edge of the image such that A,B,C,D looks like ...A,A,A,B,C,D,D,D...
+RGBA getPixelRepeated(const std::vector<RGBA> &data, int width, int height, int x, int y) {
+    int newX = (x < 0) ? 0 : std::min(x, width  - 1);
+    int newY = (y < 0) ? 0 : std::min(y, height - 1);
+    return data[width * newY + newX];
+}
+
+// Largest error, in levels, a separable approximation of a 2D kernel may add
+constexpr float SEPARABLE_MAX_ERROR = 0.5f;
+
+// assumes the input kernel is square, and has an odd-numbered side length
+void convolve2D(std::span<const float> kernel, const Image &image, std::vector<RGBA> &result,
+                const ConvolveOptions &options, FilterProgress &progress) {
+    int kernelLen = std::sqrt(kernel.size());
+    SeparableKernel separable = separateKernel(kernel, SEPARABLE_MAX_ERROR, maxSeparableTerms(kernelLen));
+    if (!separable.terms.empty()) {
+        convolveSeparable(separable, image, result, options, progress);
+    } else if (preferFFTConvolution(kernelLen, image.width, image.height)) {
+        convolve2DFFT(kernel, image, result, options, progress);
+    } else {
+        convolve2DDirect(kernel, image, result, options, progress);
+    }
+}
+
+void convolve2DDirect(std::span<const float> kernel, const Image &image, std::vector<RGBA> &result,
+                      const ConvolveOptions &options, FilterProgress &progress) {
+    TRACE_SCOPE("convolve2D");
+    // `result` temporarily stores the output image data
+    result.resize(image.data.size());
+
+    int kernelLen = std::sqrt(kernel.size());
+    int kernelOffset = kernelLen / 2;
+    float kernelSum = std::accumulate(kernel.begin(), kernel.end(), 0.0f);
+    bool renormalize = options.border == BORDER_ZERO_RENORMALIZED && std::fabs(kernelSum) > 1e-6f;
+
+    // pixels at least kernelOffset away from every edge never need border handling
+    int interiorLeft = std::min(kernelOffset, image.width);
+    int interiorRight = std::max(interiorLeft, image.width - kernelOffset);
+
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            bool borderRow = r < kernelOffset || r >= image.height - kernelOffset;
+
+            for (int c = 0; c < image.width; c++) {
+                size_t centerIndex = r * image.width + c;
+
+                // initialize redAcc, greenAcc, and blueAcc float variables
+                float redAcc = 0.0f;
+                float greenAcc = 0.0f;
+                float blueAcc = 0.0f;
+
+                if (!borderRow && c >= interiorLeft && c < interiorRight) {
+                    const RGBA *topLeft = &image.data[centerIndex - kernelOffset * image.width - kernelOffset];
+                    for (int kr = 0; kr < kernelLen; kr++) {
+                        for (int kc = 0; kc < kernelLen; kc++) {
+                            float weight = kernel[kr * kernelLen + kc];
+                            const RGBA &pixel = topLeft[kr * image.width + kc];
+
+                            redAcc += weight * pixel.r;
+                            greenAcc += weight * pixel.g;
+                            blueAcc += weight * pixel.b;
+                        }
+                    }
+                } else {
+                    float usedWeight = 0.0f;
+                    for (int kr = 0; kr < kernelLen; kr++) {
+                        int y = borderIndex(r + kr - kernelOffset, image.height, options.border);
+                        if (y < 0) {
+                            continue;
+                        }
+                        for (int kc = 0; kc < kernelLen; kc++) {
+                            int x = borderIndex(c + kc - kernelOffset, image.width, options.border);
+                            if (x < 0) {
+                                continue;
+                            }
+                            float weight = kernel[kr * kernelLen + kc];
+                            const RGBA &pixel = image.data[y * image.width + x];
+
+                            redAcc += weight * pixel.r;
+                            greenAcc += weight * pixel.g;
+                            blueAcc += weight * pixel.b;
+                            usedWeight += weight;
+                        }
+                    }
+                    if (renormalize && std::fabs(usedWeight) > 1e-6f) {
+                        float scale = kernelSum / usedWeight;
+                        redAcc *= scale;
+                        greenAcc *= scale;
+                        blueAcc *= scale;
+                    }
+                }
+
+                // update buffer with the new RGBA pixel value created from redAcc, greenAcc, and blueAcc
+                result[centerIndex] = RGBA{clamp(redAcc), clamp(greenAcc), clamp(blueAcc), 255};
+            }
+        }
+    });
+}
+
+void filterBlur(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress) {
+    TRACE_SCOPE("filterBlur");
+    int r = params.blurRadius;
+
+    if (r == 0) {
+        // identity filter
+        return;
+    }
+
+    // built once per radius for the whole process
+    const Kernel &kernel = cachedKernel(KERNEL_GAUSSIAN, r);
+
+    ConvolveOptions options = convolveOptions(params, FILTER_BLUR);
+
+    if (options.linearLight) {
+        LinearImage pass1 = takeLinear(pool, image.width, image.height);
+        BufferPool::Lease filteredData = pool.acquire(image.data.size());
+        convolve1DHorizontalLinear(kernel, image.data, pass1, options, progress);
+        convolve1DVerticalLinear(kernel, pass1, *filteredData, options, progress);
+        pool.give(std::move(pass1.storage));
+        image.data.swap(*filteredData);
+        return;
+    }
+
+    // horizontal pass into scratch, vertical pass back into a second buffer
+    BufferPool::Lease pass1Data = pool.acquire(image.data.size());
+    BufferPool::Lease filteredData = pool.acquire(image.data.size());
+    convolve1DHorizontal(kernel, image.data, *pass1Data, image.width, image.height, options, progress);
+    convolve1DVertical(kernel, *pass1Data, *filteredData, image.width, image.height, options, progress);
+
+    // swap the filtered buffer into the image; the old one goes back to the pool
+    image.data.swap(*filteredData);
+}
+
+// A (2 radius + 1)^2 kernel that spreads each pixel along a line through the
+// centre at angleDegrees, one pixel wide with antialiased sides. Axis-aligned
+// lines are rank 1 and run as 1D passes; other angles take the 2D paths.
+static std::vector<float> motionBlurKernel(int radius, float angleDegrees) {
+    int kernelLen = 2 * radius + 1;
+    double angle = angleDegrees * M_PI / 180.0;
+    // image rows grow downwards
+    double dx = std::cos(angle);
+    double dy = -std::sin(angle);
+    std::vector<float> kernel(size_t(kernelLen) * kernelLen);
+    double sum = 0.0;
+    for (int kr = 0; kr < kernelLen; kr++) {
+        for (int kc = 0; kc < kernelLen; kc++) {
+            double x = kc - radius;
+            double y = kr - radius;
+            double along = std::clamp(x * dx + y * dy, double(-radius), double(radius));
+            double distance = std::hypot(x - along * dx, y - along * dy);
+            double weight = std::max(0.0, 1.0 - distance);
+            kernel[kr * kernelLen + kc] = weight;
+            sum += weight;
+        }
+    }
+    for (float &weight : kernel) {
+        weight /= sum;
+    }
+    return kernel;
+}
+
+void filterMotionBlur(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress) {
+    TRACE_SCOPE("filterMotionBlur");
+    if (params.blurRadius == 0) {
+        return;
+    }
+    std::vector<float> kernel = motionBlurKernel(params.blurRadius, params.blurAngle);
+    // convolve2D's fused, FFT and direct paths only take the border mode, so
+    // clear the other options rather than have them apply only on the 1D route
+    // that axis-aligned angles take
+    ConvolveOptions options = convolveOptions(params, FILTER_BLUR);
+    options.fixedPoint = false;
+    options.linearLight = false;
+    BufferPool::Lease result = pool.acquire(image.data.size());
+    convolve2D(kernel, image, *result, options, progress);
+    image.data.swap(*result);
+}
+
+std::uint8_t rgbaToGray(const RGBA &pixel) {
+    std::uint8_t grayValue = static_cast<std::uint8_t>(0.299 * pixel.r + 0.587 * pixel.g + 0.114 * pixel.b);
+    return clamp(grayValue);
+}
+
+void filterGray(Image &image, FilterProgress &progress) {
+    TRACE_SCOPE("filterGray");
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            for (int col = 0; col < image.width; ++col) {
+                size_t currentIndex = image.width * row + col;
+                RGBA &currentPixel = image.data[currentIndex];
+
+                // call rgbaToGray()
+                std::uint8_t resultGray = rgbaToGray(currentPixel);
+                // update currentPixel's color
+                currentPixel.r = resultGray;
+                currentPixel.g = resultGray;
+                currentPixel.b = resultGray;
+            }
+        }
+    });
+}
+
+GrayImage takeGray(BufferPool &pool, int width, int height) {
+    return GrayImage{width, height, pool.take(GrayImage::storagePixels(width, height))};
+}
+
+LinearImage takeLinear(BufferPool &pool, int width, int height) {
+    return LinearImage{width, height, pool.take(LinearImage::storagePixels(width, height))};
+}
+
+void toGray(const Image &image, GrayImage &gray, FilterProgress &progress) {
+    TRACE_SCOPE("toGray");
+    std::uint8_t *out = gray.data();
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (size_t i = size_t(rowBegin) * image.width; i < size_t(rowEnd) * image.width; i++) {
+            out[i] = rgbaToGray(image.data[i]);
+        }
+    });
+}
+
+void promoteGray(const GrayImage &gray, Image &image, FilterProgress &progress) {
+    TRACE_SCOPE("promoteGray");
+    const std::uint8_t *in = gray.data();
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (size_t i = size_t(rowBegin) * image.width; i < size_t(rowEnd) * image.width; i++) {
+            image.data[i].r = in[i];
+            image.data[i].g = in[i];
+            image.data[i].b = in[i];
+        }
+    });
+}
+
+void filterEdgeDetect(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                      const GrayImage *gray) {
+    TRACE_SCOPE("filterEdgeDetect");
+    int w = image.width;
+    int h = image.height;
+
+    // everything after the conversion carries one byte per pixel
+    GrayImage converted;
+    if (!gray) {
+        converted = takeGray(pool, w, h);
+        toGray(image, converted, progress);
+        gray = &converted;
+    }
+
+    // separable sobel kernels
+    const Kernel &sobelXHorizontal = cachedKernel(KERNEL_SOBEL_DERIVATIVE);
+    const Kernel &sobelXVertical = cachedKernel(KERNEL_SOBEL_SMOOTH);
+
+    const Kernel &sobelYHorizontal = cachedKernel(KERNEL_SOBEL_SMOOTH);
+    const Kernel &sobelYVertical = cachedKernel(KERNEL_SOBEL_DERIVATIVE);
+
+    ConvolveOptions options = convolveOptions(params, FILTER_EDGE_DETECT);
+
+    // the first-pass plane is reused for both gradients
+    GrayImage pass1 = takeGray(pool, w, h);
+    GrayImage G_x = takeGray(pool, w, h);
+    GrayImage G_y = takeGray(pool, w, h);
+
+    // compute gradient in x direction
+    convolve1DHorizontalGray(sobelXHorizontal, *gray, pass1, options, progress);
+    convolve1DVerticalGray(sobelXVertical, pass1, G_x, options, progress);
+
+    // compute gradient in y direction
+    convolve1DHorizontalGray(sobelYHorizontal, *gray, pass1, options, progress);
+    convolve1DVerticalGray(sobelYVertical, pass1, G_y, options, progress);
+
+    // rgbaToGray() of a gray pixel, which the magnitude has always been taken
+    // of; it is not quite the identity
+    std::array<float, 256> grayOfGray;
+    for (int v = 0; v < 256; v++) {
+        grayOfGray[v] = rgbaToGray(RGBA{std::uint8_t(v), std::uint8_t(v), std::uint8_t(v), 255});
+    }
+
+    // approximate magnitude of the gradient of image, written into the first-pass plane
+    std::uint8_t *magnitude = pass1.data();
+    const std::uint8_t *gradientX = G_x.data();
+    const std::uint8_t *gradientY = G_y.data();
+    forEachStrip(h, progress, [&](int rowBegin, int rowEnd) {
+        for (size_t i = size_t(rowBegin) * w; i < size_t(rowEnd) * w; i++) {
+            float gradient_x = grayOfGray[gradientX[i]];
+            float gradient_y = grayOfGray[gradientY[i]];
+
+            float G_mag = std::sqrt(gradient_x * gradient_x + gradient_y * gradient_y);
+            G_mag *= params.edgeDetectSensitivity; //multiply by sensitivity parameter
+            magnitude[i] = clamp(G_mag);
+        }
+    });
+
+    // back to RGBA only for the canvas
+    FilterProgress untracked;
+    promoteGray(pass1, image, untracked);
+
+    pool.give(std::move(converted.storage));
+    pool.give(std::move(pass1.storage));
+    pool.give(std::move(G_x.storage));
+    pool.give(std::move(G_y.storage));
+}
+
+ConvolveOptions convolveOptions(const Settings &params, int filterType) {
+    ConvolveOptions options;
+    switch (filterType) {
+    case FILTER_BLUR:
+        options.fixedPoint = params.blurFixedPoint;
+        options.border = static_cast<BorderMode>(params.blurBorderMode);
+        options.linearLight = params.linearLight;
+        break;
+    case FILTER_EDGE_DETECT:
+        options.fixedPoint = params.edgeDetectFixedPoint;
+        options.border = static_cast<BorderMode>(params.edgeDetectBorderMode);
+        break;
+    case FILTER_SCALE:
+        options.fixedPoint = params.scaleFixedPoint;
+        options.border = static_cast<BorderMode>(params.scaleBorderMode);
+        options.linearLight = params.linearLight;
+        break;
+    default:
+        break;
+    }
+    return options;
+}
+
+// The passes below quantize the kernel for the fixed-point path themselves
+// unless given its quantized weights
+
+static void horizontalPass(std::span<const float> kernel, const FixedPointKernel *quantized,
+                           const std::vector<RGBA> &input, std::vector<RGBA> &output, int width, int height,
+                           const ConvolveOptions &options, FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DHorizontal");
+    output.resize(input.size());
+    int kernelOffset = kernel.size() / 2;
+
+    if (options.fixedPoint) {
+        FixedPointKernel fixedKernel = quantized ? FixedPointKernel{} : quantizeKernel(kernel);
+        const FixedPointKernel &weights = quantized ? *quantized : fixedKernel;
+        forEachStrip(height, progress, [&](int rowBegin, int rowEnd) {
+            convolveRowsHorizontalFixed(weights, options.border, input.data(), output.data(), width, height, rowBegin, rowEnd);
+        });
+        return;
+    }
+
+    ConvolveRowsFn convolveRows = horizontalConvolver(kernelOffset);
+    forEachStrip(height, progress, [&](int rowBegin, int rowEnd) {
+        convolveRows(kernel.data(), kernelOffset, options.border, input.data(), output.data(), width, height, rowBegin, rowEnd);
+    });
+}
+
+static void verticalPass(std::span<const float> kernel, const FixedPointKernel *quantized,
+                         const std::vector<RGBA> &input, std::vector<RGBA> &output, int width, int height,
+                         const ConvolveOptions &options, FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DVertical");
+    output.resize(input.size());
+    int kernelOffset = kernel.size() / 2;
+
+    if (options.fixedPoint) {
+        FixedPointKernel fixedKernel = quantized ? FixedPointKernel{} : quantizeKernel(kernel);
+        const FixedPointKernel &weights = quantized ? *quantized : fixedKernel;
+        forEachStrip(height, progress, [&](int rowBegin, int rowEnd) {
+            convolveRowsVerticalFixed(weights, options.border, input.data(), output.data(), width, height, rowBegin, rowEnd);
+        });
+        return;
+    }
+
+    ConvolveRowsFn convolveRows = verticalConvolver(kernelOffset);
+    forEachStrip(height, progress, [&](int rowBegin, int rowEnd) {
+        convolveRows(kernel.data(), kernelOffset, options.border, input.data(), output.data(), width, height, rowBegin, rowEnd);
+    });
+}
+
+static void horizontalGrayPass(std::span<const float> kernel, const FixedPointKernel *quantized,
+                               const GrayImage &input, GrayImage &output, const ConvolveOptions &options,
+                               FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DHorizontalGray");
+    int kernelOffset = kernel.size() / 2;
+    if (options.fixedPoint) {
+        FixedPointKernel fixedKernel = quantized ? FixedPointKernel{} : quantizeKernel(kernel);
+        const FixedPointKernel &weights = quantized ? *quantized : fixedKernel;
+        forEachStrip(input.height, progress, [&](int rowBegin, int rowEnd) {
+            convolveGrayRowsHorizontalFixed(weights, options.border, input.data(), output.data(), input.width,
+                                            input.height, rowBegin, rowEnd);
+        });
+        return;
+    }
+    forEachStrip(input.height, progress, [&](int rowBegin, int rowEnd) {
+        convolveGrayRowsHorizontal(kernel.data(), kernelOffset, options.border, input.data(), output.data(), input.width,
+                                   input.height, rowBegin, rowEnd);
+    });
+}
+
+static void verticalGrayPass(std::span<const float> kernel, const FixedPointKernel *quantized,
+                             const GrayImage &input, GrayImage &output, const ConvolveOptions &options,
+                             FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DVerticalGray");
+    int kernelOffset = kernel.size() / 2;
+    if (options.fixedPoint) {
+        FixedPointKernel fixedKernel = quantized ? FixedPointKernel{} : quantizeKernel(kernel);
+        const FixedPointKernel &weights = quantized ? *quantized : fixedKernel;
+        forEachStrip(input.height, progress, [&](int rowBegin, int rowEnd) {
+            convolveGrayRowsVerticalFixed(weights, options.border, input.data(), output.data(), input.width,
+                                          input.height, rowBegin, rowEnd);
+        });
+        return;
+    }
+    forEachStrip(input.height, progress, [&](int rowBegin, int rowEnd) {
+        convolveGrayRowsVertical(kernel.data(), kernelOffset, options.border, input.data(), output.data(), input.width,
+                                 input.height, rowBegin, rowEnd);
+    });
+}
+
+void convolve1DHorizontal(std::span<const float> kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                          int width, int height, const ConvolveOptions &options, FilterProgress &progress) {
+    horizontalPass(kernel, nullptr, input, output, width, height, options, progress);
+}
+
+void convolve1DHorizontal(const Kernel &kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                          int width, int height, const ConvolveOptions &options, FilterProgress &progress) {
+    horizontalPass(kernel, &kernel.fixedPoint(), input, output, width, height, options, progress);
+}
+
+void convolve1DVertical(std::span<const float> kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                        int width, int height, const ConvolveOptions &options, FilterProgress &progress) {
+    verticalPass(kernel, nullptr, input, output, width, height, options, progress);
+}
+
+void convolve1DVertical(const Kernel &kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                        int width, int height, const ConvolveOptions &options, FilterProgress &progress) {
+    verticalPass(kernel, &kernel.fixedPoint(), input, output, width, height, options, progress);
+}
+
+void convolve1DHorizontalGray(std::span<const float> kernel, const GrayImage &input, GrayImage &output,
+                              const ConvolveOptions &options, FilterProgress &progress) {
+    horizontalGrayPass(kernel, nullptr, input, output, options, progress);
+}
+
+void convolve1DHorizontalGray(const Kernel &kernel, const GrayImage &input, GrayImage &output,
+                              const ConvolveOptions &options, FilterProgress &progress) {
+    horizontalGrayPass(kernel, &kernel.fixedPoint(), input, output, options, progress);
+}
+
+void convolve1DVerticalGray(std::span<const float> kernel, const GrayImage &input, GrayImage &output,
+                            const ConvolveOptions &options, FilterProgress &progress) {
+    verticalGrayPass(kernel, nullptr, input, output, options, progress);
+}
+
+void convolve1DVerticalGray(const Kernel &kernel, const GrayImage &input, GrayImage &output,
+                            const ConvolveOptions &options, FilterProgress &progress) {
+    verticalGrayPass(kernel, &kernel.fixedPoint(), input, output, options, progress);
+}
+
+void convolve1DHorizontalLinear(const Kernel &kernel, const std::vector<RGBA> &input, LinearImage &output,
+                                const ConvolveOptions &options, FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DHorizontalLinear");
+    forEachStrip(output.height, progress, [&](int rowBegin, int rowEnd) {
+        convolveRowsHorizontalLinear(kernel.taps().data(), kernel.radius(), options.border, input.data(), output.data(),
+                                     output.width, output.height, rowBegin, rowEnd);
+    });
+}
+
+void convolve1DVerticalLinear(const Kernel &kernel, const LinearImage &input, std::vector<RGBA> &output,
+                              const ConvolveOptions &options, FilterProgress &progress) {
+    TRACE_SCOPE("convolve1DVerticalLinear");
+    output.resize(std::size_t(input.width) * input.height);
+    forEachStrip(input.height, progress, [&](int rowBegin, int rowEnd) {
+        convolveRowsVerticalLinear(kernel.taps().data(), kernel.radius(), options.border, input.data(), output.data(),
+                                   input.width, input.height, rowBegin, rowEnd);
+    });
+}
+
+// Output size of the scale filter for the given scale factors
+static void scaledSize(const Image &image, const Settings &params, int &newWidth, int &newHeight) {
+    newWidth = round(image.width * params.scaleX);
+    newHeight = round(image.height * params.scaleY);
+}
+
+void filterScale(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress) {
+    TRACE_SCOPE("filterScale");
+    float scaleX = params.scaleX;
+    float scaleY = params.scaleY;
+
+    float supportX;
+    float supportY;
+
+    // scale x support
+    if (scaleX >= 1) { // upscale
+        supportX = 2.0f;
+    } else { // downscale
+        supportX = 2.0f / scaleX;
+    }
+
+    // scale y support
+    if (scaleY >= 1) { // upscale
+        supportY = 2.0f;
+    } else { // downscale
+        supportY = 2.0f / scaleY;
+    }
+
+    // normalized triangle kernels
+    const Kernel &kernelX = cachedKernel(KERNEL_TRIANGLE, supportX);
+    const Kernel &kernelY = cachedKernel(KERNEL_TRIANGLE, supportY);
+
+    ConvolveOptions options = convolveOptions(params, FILTER_SCALE);
+
+    BufferPool::Lease filteredLease = pool.acquire(image.data.size());
+    const std::vector<RGBA> &filteredData = *filteredLease;
+
+    if (options.linearLight) {
+        // filtered in linear light, then resampled from the encoded result
+        LinearImage pass1 = takeLinear(pool, image.width, image.height);
+        convolve1DHorizontalLinear(kernelX, image.data, pass1, options, progress);
+        convolve1DVerticalLinear(kernelY, pass1, *filteredLease, options, progress);
+        pool.give(std::move(pass1.storage));
+    } else {
+        BufferPool::Lease pass1Data = pool.acquire(image.data.size());
+
+        // horizontal pass
+        convolve1DHorizontal(kernelX, image.data, *pass1Data, image.width, image.height, options, progress);
+
+        // vertical pass
+        convolve1DVertical(kernelY, *pass1Data, *filteredLease, image.width, image.height, options, progress);
+    }
+
+    // resample
+    int newWidth;
+    int newHeight;
+    scaledSize(image, params, newWidth, newHeight);
+    BufferPool::Lease scaledLease = pool.acquire(newWidth * newHeight);
+    std::vector<RGBA> &scaledData = *scaledLease;
+
+    forEachStrip(newHeight, progress, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            for (int c = 0; c < newWidth; c++) {
+                float originalX = c / scaleX;
+                float originalY = r / scaleY;
+
+                RGBA pixel = getPixelRepeated(filteredData, image.width, image.height, round(originalX), round(originalY));
+
+                int index = r * newWidth + c;
+                scaledData[index] = pixel;
+            }
+        }
+    });
+
+    // update image; the old buffer goes back to the pool
+    image.data.swap(scaledData);
+    image.width = newWidth;
+    image.height = newHeight;
+}
+
+// Fraction of pixels tone mapping lets clip at each end of a channel's range,
+// so a few outliers do not stop the rest of the image from being stretched
+constexpr float TONE_MAP_CLIP = 0.005f;
+
+/**
+ * @brief Stretches each channel so that its [TONE_MAP_CLIP, 1 - TONE_MAP_CLIP]
+ * percentile range covers [0, 255] (auto-levels), then optionally applies a
+ * gamma curve. The lookup tables come from the histograms in stats, so the
+ * image is only read once, to apply them.
+ */
+void filterToneMap(Image &image, const Settings &params, const ImageStats &stats, FilterProgress &progress) {
+    TRACE_SCOPE("filterToneMap");
+    std::array<std::array<std::uint8_t, 256>, 3> lut;
+    for (int channel = STATS_RED; channel <= STATS_BLUE; channel++) {
+        int low = stats.percentile(channel, TONE_MAP_CLIP);
+        int high = stats.percentile(channel, 1.0f - TONE_MAP_CLIP);
+        if (high <= low) {
+            // (nearly) flat channel; fall back to the full range
+            low = stats.min[channel];
+            high = stats.max[channel];
+        }
+        for (int value = 0; value < 256; value++) {
+            float t = high > low ? std::clamp((value - low) / float(high - low), 0.0f, 1.0f) : value / 255.0f;
+            if (params.nonLinearMap) {
+                t = std::pow(t, params.gamma);
+            }
+            lut[channel][value] = clamp(255.0f * t);
+        }
+    }
+
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (size_t i = size_t(rowBegin) * image.width; i < size_t(rowEnd) * image.width; i++) {
+            RGBA &pixel = image.data[i];
+            pixel.r = lut[STATS_RED][pixel.r];
+            pixel.g = lut[STATS_GREEN][pixel.g];
+            pixel.b = lut[STATS_BLUE][pixel.b];
+        }
+    });
+}
+
+Image downsampleBox(const Image &image, int factor) {
+    return downsampleBox(image.data.data(), image.width, image.height, factor);
+}
+
+Image downsampleBox(const RGBA *data, int width, int height, int factor) {
+    TRACE_SCOPE("downsampleBox");
+    Image proxy;
+    proxy.width = std::max(1, width / factor);
+    proxy.height = std::max(1, height / factor);
+    proxy.data.resize(proxy.width * proxy.height);
+
+    FilterProgress progress;
+    forEachStrip(proxy.height, progress, [&](int rowBegin, int rowEnd) {
+        for (int r = rowBegin; r < rowEnd; r++) {
+            for (int c = 0; c < proxy.width; c++) {
+                int redAcc = 0;
+                int greenAcc = 0;
+                int blueAcc = 0;
+                int alphaAcc = 0;
+                int count = 0;
+
+                for (int y = r * factor; y < std::min((r + 1) * factor, height); y++) {
+                    for (int x = c * factor; x < std::min((c + 1) * factor, width); x++) {
+                        const RGBA &pixel = data[size_t(y) * width + x];
+                        redAcc += pixel.r;
+                        greenAcc += pixel.g;
+                        blueAcc += pixel.b;
+                        alphaAcc += pixel.a;
+                        count++;
+                    }
+                }
+
+                proxy.data[r * proxy.width + c] = RGBA{std::uint8_t(redAcc / count), std::uint8_t(greenAcc / count),
+                                                       std::uint8_t(blueAcc / count), std::uint8_t(alphaAcc / count)};
+            }
+        }
+    });
+
+    return proxy;
+}
+
+Settings proxyParams(const Settings &params, int factor) {
+    Settings scaled = params;
+    scaled.blurRadius = static_cast<int>(std::round(params.blurRadius / float(factor)));
+    return scaled;
+}
+
+/**
+ * @brief Runs the filter selected in params on image, publishing the total
+ * number of strips up front so progress can be shown as a fraction
+ */
+bool applyFilter(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                 const ImageStats *stats, const GrayImage *gray) {
+    int strips = stripCount(image.height);
+
+    switch (params.filterType) {
+    case FILTER_BLUR:
+        // two passes, or the summed-area table and the box means
+        progress.stripsTotal = params.blurRadius == 0 ? 0 : 2 * strips;
+        if (params.blurType == BLUR_MOTION) {
+            // one 2D pass; convolve2D adds a second if it splits the kernel
+            progress.stripsTotal = params.blurRadius == 0 ? 0 : strips;
+            filterMotionBlur(image, params, pool, progress);
+        } else if (params.blurType == BLUR_BOX) {
+            filterBoxBlur(image, params.blurRadius, progress);
+        } else if (params.blurType == BLUR_TILT_SHIFT) {
+            filterTiltShift(image, params.blurRadius, progress);
+        } else {
+            filterBlur(image, params, pool, progress);
+        }
+        break;
+    case FILTER_EDGE_DETECT:
+        if (params.edgeDetectCanny) {
+            progress.stripsTotal = (gray ? CANNY_PASSES - 1 : CANNY_PASSES) * strips;
+            filterCanny(image, params, pool, progress, gray);
+            break;
+        }
+        // gray unless given, four sobel passes and the magnitude
+        progress.stripsTotal = (gray ? 5 : 6) * strips;
+        filterEdgeDetect(image, params, pool, progress, gray);
+        break;
+    case FILTER_SCALE: {
+        int newWidth;
+        int newHeight;
+        scaledSize(image, params, newWidth, newHeight);
+        progress.stripsTotal = 2 * strips + stripCount(newHeight);
+        filterScale(image, params, pool, progress);
+        break;
+    }
+    case FILTER_MAPPING: {
+        progress.stripsTotal = strips;
+        if (stats) {
+            filterToneMap(image, params, *stats, progress);
+        } else {
+            filterToneMap(image, params, computeImageStats(image.data.data(), image.data.size()), progress);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return !progress.isCancelled();
+}
@@ -0,0 +1,164 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "bufferpool.h"
+#include "convolve.h"
+#include "kernels.h"
+#include "rgba.h"
+#include "srgb.h"
+#include "stats.h"
+#include "threadpool.h"
+
+struct Settings;
+
+// An RGBA image detached from the canvas, so that filters can run on a
+// snapshot off the GUI thread
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<RGBA> data;
+};
+
+// A single-channel 8-bit luminance image, for pipelines that only carry gray
+// (edge detection): a quarter of the memory and bandwidth of an Image. The
+// bytes live in an RGBA vector a quarter the pixel count, so gray planes are
+// recycled through the same BufferPool as color ones.
+struct GrayImage {
+    int width = 0;
+    int height = 0;
+    std::vector<RGBA> storage;
+
+    std::uint8_t *data() { return reinterpret_cast<std::uint8_t *>(storage.data()); }
+    const std::uint8_t *data() const { return reinterpret_cast<const std::uint8_t *>(storage.data()); }
+
+    static std::size_t storagePixels(int width, int height) { return (std::size_t(width) * height + 3) / 4; }
+};
+
+/**
+ * @struct FilterProgress
+ *
+ * Progress and cancellation state shared between a running filter and the
+ * thread that submitted it. Filters process images in horizontal strips of
+ * FILTER_STRIP_ROWS rows; stripsDone ticks once per finished strip and
+ * cancellation is checked before each strip starts. A filter that runs others
+ * on pieces of its image with progress of their own points their parent at
+ * its progress, so that cancelling it cancels them too.
+ */
+struct FilterProgress {
+    std::atomic<int> stripsDone = 0;
+    std::atomic<int> stripsTotal = 0;
+    std::atomic<bool> cancelled = false;
+    const FilterProgress *parent = nullptr;
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const {
+        return cancelled.load(std::memory_order_relaxed) || (parent && parent->isCancelled());
+    }
+};
+
+constexpr int FILTER_STRIP_ROWS = 32;
+
+int stripCount(int rows);
+
+// Runs body(rowBegin, rowEnd) over every strip of [0, rows) on the thread pool.
+// Returns false if the filter was cancelled before all strips ran.
+bool forEachStrip(int rows, FilterProgress &progress, FunctionRef<void(int, int)> body);
+
+// Applies the filter selected in params to image in place, taking scratch
+// buffers from pool. Returns false if the filter was cancelled, in which case
+// image is left in an unspecified state. Filters that need image statistics
+// use stats when given (e.g. cached by the canvas) and compute them otherwise;
+// likewise the Sobel filter starts from gray, the luminance of image, if given.
+bool applyFilter(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                 const ImageStats *stats = nullptr, const GrayImage *gray = nullptr);
+
+// Ensures the value lies within [0, 255]
+inline std::uint8_t clamp(float x) {
+    if (x < 0.0f) return 0;
+    if (x > 255.0f) return 255;
+    return static_cast<std::uint8_t>(std::min(std::max(std::round(x), 0.0f), 255.0f));
+}
+
+// Averages each factor x factor block of image into one pixel
+Image downsampleBox(const Image &image, int factor);
+// The same, reading a width x height image in place
+Image downsampleBox(const RGBA *data, int width, int height, int factor);
+
+// Adjusts size-dependent parameters (e.g. blur radius) so that filtering an
+// image downsampled by factor approximates filtering the original
+Settings proxyParams(const Settings &params, int factor);
+
+// A width x height gray plane backed by a buffer from pool; give
+// gray.storage back when done
+GrayImage takeGray(BufferPool &pool, int width, int height);
+
+// Luminance of image into gray (same size), and back into the r, g and b of
+// image, leaving its alpha alone
+void toGray(const Image &image, GrayImage &gray, FilterProgress &progress);
+void promoteGray(const GrayImage &gray, Image &image, FilterProgress &progress);
+
+// A width x height linear-light plane backed by a buffer from pool; give
+// linear.storage back when done
+LinearImage takeLinear(BufferPool &pool, int width, int height);
+
+RGBA getPixelRepeated(const std::vector<RGBA> &data, int width, int height, int x, int y);
+std::uint8_t rgbaToGray(const RGBA &pixel);
+
+// The convolution options params selects for filterType
+ConvolveOptions convolveOptions(const Settings &params, int filterType);
+
+// Convolution passes write every pixel of output, resizing it to the input size
+// (which does not reallocate for a pooled buffer of the right size class).
+// convolve2D runs kernels that are (close to) a sum of a few separable terms as
+// 1D passes (see separable.h), and the rest on the direct or the FFT path (see
+// fft.h), whichever is faster. Every path reports one pass of strips; a kernel
+// that runs as two ordinary 1D passes adds the second to stripsTotal.
+void convolve2D(std::span<const float> kernel, const Image &image, std::vector<RGBA> &output,
+                const ConvolveOptions &options, FilterProgress &progress);
+void convolve2DDirect(std::span<const float> kernel, const Image &image, std::vector<RGBA> &output,
+                      const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DHorizontal(std::span<const float> kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                          int width, int height, const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DVertical(std::span<const float> kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                        int width, int height, const ConvolveOptions &options, FilterProgress &progress);
+
+// The same passes over gray planes; output must already be input's size
+void convolve1DHorizontalGray(std::span<const float> kernel, const GrayImage &input, GrayImage &output,
+                              const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DVerticalGray(std::span<const float> kernel, const GrayImage &input, GrayImage &output,
+                            const ConvolveOptions &options, FilterProgress &progress);
+
+// The 1D passes with a cached kernel (see kernels.h), whose fixed-point
+// weights are quantized already
+void convolve1DHorizontal(const Kernel &kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                          int width, int height, const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DVertical(const Kernel &kernel, const std::vector<RGBA> &input, std::vector<RGBA> &output,
+                        int width, int height, const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DHorizontalGray(const Kernel &kernel, const GrayImage &input, GrayImage &output,
+                              const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DVerticalGray(const Kernel &kernel, const GrayImage &input, GrayImage &output,
+                            const ConvolveOptions &options, FilterProgress &progress);
+
+// The linear-light passes (see srgb.h): the horizontal one decodes an sRGB
+// image into output, which must already be its size, and the vertical one
+// encodes back into output, resizing it
+void convolve1DHorizontalLinear(const Kernel &kernel, const std::vector<RGBA> &input, LinearImage &output,
+                                const ConvolveOptions &options, FilterProgress &progress);
+void convolve1DVerticalLinear(const Kernel &kernel, const LinearImage &input, std::vector<RGBA> &output,
+                              const ConvolveOptions &options, FilterProgress &progress);
+
+void filterBlur(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress);
+void filterMotionBlur(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress);
+void filterGray(Image &image, FilterProgress &progress);
+void filterEdgeDetect(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                      const GrayImage *gray = nullptr);
+void filterScale(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress);
+void filterToneMap(Image &image, const Settings &params, const ImageStats &stats, FilterProgress &progress);
+
+#endif // FILTER_H
@@ -0,0 +1,154 @@
+#include "filtercache.h"
+#include <algorithm>
+#include <cstring>
+#include "threadpool.h"
+#include "trace.h"
+
+// Pixels each task of hashPixels() hashes
+constexpr std::size_t HASH_CHUNK_PIXELS = std::size_t(1) << 20;
+
+namespace {
+
+std::uint64_t mix(std::uint64_t hash, std::uint64_t word) {
+    hash ^= word * 0x9E3779B97F4A7C15ull;
+    hash = (hash << 29) | (hash >> 35);
+    return hash * 0xBF58476D1CE4E5B9ull;
+}
+
+std::uint64_t hashBytes(const std::uint8_t *bytes, std::size_t count) {
+    std::uint64_t hash = count;
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = mix(hash, word);
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, count - i);
+    return mix(hash, tail);
+}
+
+} // namespace
+
+std::uint64_t hashPixels(const RGBA *data, std::size_t pixels) {
+    TRACE_SCOPE("hashPixels");
+    int chunks = static_cast<int>((pixels + HASH_CHUNK_PIXELS - 1) / HASH_CHUNK_PIXELS);
+    std::vector<std::uint64_t> chunkHashes(chunks);
+    ThreadPool::instance().parallelFor(0, chunks, [&](int chunk) {
+        std::size_t begin = chunk * HASH_CHUNK_PIXELS;
+        std::size_t end = std::min(pixels, begin + HASH_CHUNK_PIXELS);
+        chunkHashes[chunk] = hashBytes(reinterpret_cast<const std::uint8_t *>(data + begin), (end - begin) * sizeof(RGBA));
+    });
+    std::uint64_t hash = pixels;
+    for (std::uint64_t chunkHash : chunkHashes) {
+        hash = mix(hash, chunkHash);
+    }
+    return hash;
+}
+
+std::vector<float> filterParamsKey(const Settings &params) {
+    std::vector<float> key{float(params.filterType)};
+    switch (params.filterType) {
+    case FILTER_BLUR:
+        key.insert(key.end(), {float(params.blurType), float(params.blurRadius)});
+        if (params.blurType == BLUR_GAUSSIAN) {
+            key.insert(key.end(), {float(params.blurFixedPoint), float(params.blurBorderMode), float(params.linearLight)});
+        } else if (params.blurType == BLUR_MOTION) {
+            key.insert(key.end(), {params.blurAngle, float(params.blurBorderMode)});
+        }
+        break;
+    case FILTER_EDGE_DETECT:
+        key.insert(key.end(), {params.edgeDetectSensitivity, float(params.edgeDetectFixedPoint),
+                               float(params.edgeDetectBorderMode), float(params.edgeDetectCanny)});
+        break;
+    case FILTER_SCALE:
+        key.insert(key.end(), {params.scaleX, params.scaleY, float(params.scaleFixedPoint), float(params.scaleBorderMode),
+                               float(params.linearLight)});
+        break;
+    case FILTER_MAPPING:
+        key.insert(key.end(), {float(params.nonLinearMap), params.gamma});
+        break;
+    default:
+        break;
+    }
+    return key;
+}
+
+FilterCacheKey filterCacheKey(std::uint64_t content, int width, int height, const Settings &params,
+                              const FilterRegion &region, int proxyFactor) {
+    FilterCacheKey key;
+    key.content = content;
+    key.width = width;
+    key.height = height;
+    key.proxyFactor = proxyFactor;
+    key.region = region.bounds;
+    if (!region.mask.empty()) {
+        key.regionMask = hashBytes(region.mask.data(), region.mask.size());
+    }
+    key.params = filterParamsKey(params);
+    return key;
+}
+
+FilterCache::Entry *FilterCache::find(const FilterCacheKey &key, bool gray) {
+    auto found = std::find_if(m_entries.begin(), m_entries.end(),
+                              [&](const Entry &entry) { return entry.gray == gray && entry.key == key; });
+    if (found == m_entries.end()) {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_entries.splice(m_entries.begin(), m_entries, found);
+    return &m_entries.front();
+}
+
+/**
+ * @brief Adds entry as the most recently used, replacing any entry with the
+ * same key, then evicts from the least recently used end until the budget is
+ * met. Entries larger than the whole budget are not kept at all.
+ */
+void FilterCache::insert(Entry entry) {
+    if (entry.bytes > m_budgetBytes) {
+        return;
+    }
+    auto stale = std::find_if(m_entries.begin(), m_entries.end(),
+                              [&](const Entry &other) { return other.gray == entry.gray && other.key == entry.key; });
+    if (stale != m_entries.end()) {
+        m_bytes -= stale->bytes;
+        m_entries.erase(stale);
+    }
+    m_bytes += entry.bytes;
+    m_entries.push_front(std::move(entry));
+    while (m_bytes > m_budgetBytes) {
+        m_bytes -= m_entries.back().bytes;
+        m_entries.pop_back();
+    }
+}
+
+std::shared_ptr<const Image> FilterCache::findResult(const FilterCacheKey &key) {
+    Entry *entry = find(key, false);
+    return entry ? entry->image : nullptr;
+}
+
+void FilterCache::insertResult(const FilterCacheKey &key, std::shared_ptr<const Image> result) {
+    std::size_t bytes = result->data.size() * sizeof(RGBA);
+    insert(Entry{key, false, std::move(result), nullptr, bytes});
+}
+
+std::shared_ptr<const GrayImage> FilterCache::findGray(std::uint64_t content) {
+    FilterCacheKey key;
+    key.content = content;
+    Entry *entry = find(key, true);
+    return entry ? entry->grayImage : nullptr;
+}
+
+void FilterCache::insertGray(std::uint64_t content, std::shared_ptr<const GrayImage> gray) {
+    FilterCacheKey key;
+    key.content = content;
+    std::size_t bytes = gray->storage.size() * sizeof(RGBA);
+    insert(Entry{key, true, nullptr, std::move(gray), bytes});
+}
+
+void FilterCache::clear() {
+    m_entries.clear();
+    m_bytes = 0;
+}
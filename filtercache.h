@@ -0,0 +1,91 @@
+#ifndef FILTERCACHE_H
+#define FILTERCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+#include "filter.h"
+#include "region.h"
+#include "settings.h"
+
+/**
+ * @class FilterCache
+ *
+ * Memoized filter results. Results are keyed by a hash of the pixels they
+ * were computed from, plus only the Settings fields the filter reads, so
+ * toggling back to an earlier parameter, or filtering the same content
+ * again (e.g. after reloading an image), returns the stored result instead of
+ * recomputing it. Sub-results shared between filters are cached the same way;
+ * currently the gray plane edge detection starts from, which every
+ * sensitivity, border mode and fixed-point setting of the Sobel filter reuses.
+ *
+ * Entries are kept most recently used first and evicted from the back once
+ * their pixels exceed the memory budget. There are only ever a few dozen
+ * entries, so lookups are a linear scan. Not thread-safe; the canvas uses it
+ * from the GUI thread only.
+ */
+
+constexpr std::size_t FILTER_CACHE_BUDGET_BYTES = std::size_t(512) << 20;
+
+// Hash of data[0, pixels), computed in parallel chunks; equal for equal pixels
+std::uint64_t hashPixels(const RGBA *data, std::size_t pixels);
+
+// filterType followed by the Settings fields the selected filter reads; two
+// settings with equal keys produce the same result
+std::vector<float> filterParamsKey(const Settings &params);
+
+struct FilterCacheKey {
+    std::uint64_t content = 0;      // hashPixels() of the input
+    int width = 0;
+    int height = 0;
+    int proxyFactor = 1;            // downsampling of a preview proxy, 1 for full results
+    PixelRect region;               // selection bounds, empty for the whole image
+    std::uint64_t regionMask = 0;   // hash of the selection's mask, if it has one
+    std::vector<float> params;      // filterParamsKey()
+
+    bool operator==(const FilterCacheKey &other) const = default;
+};
+
+FilterCacheKey filterCacheKey(std::uint64_t content, int width, int height, const Settings &params,
+                              const FilterRegion &region = {}, int proxyFactor = 1);
+
+class FilterCache {
+public:
+    explicit FilterCache(std::size_t budgetBytes = FILTER_CACHE_BUDGET_BYTES) : m_budgetBytes(budgetBytes) {}
+
+    // The cached result for key, or null; a hit becomes the most recently used
+    std::shared_ptr<const Image> findResult(const FilterCacheKey &key);
+    void insertResult(const FilterCacheKey &key, std::shared_ptr<const Image> result);
+
+    // The luminance plane of content, or null
+    std::shared_ptr<const GrayImage> findGray(std::uint64_t content);
+    void insertGray(std::uint64_t content, std::shared_ptr<const GrayImage> gray);
+
+    void clear();
+
+    std::size_t bytes() const { return m_bytes; }
+    std::uint64_t hits() const { return m_hits; }
+    std::uint64_t misses() const { return m_misses; }
+
+private:
+    struct Entry {
+        FilterCacheKey key;
+        bool gray = false;          // a gray plane sub-result rather than a filter result
+        std::shared_ptr<const Image> image;
+        std::shared_ptr<const GrayImage> grayImage;
+        std::size_t bytes = 0;
+    };
+
+    std::list<Entry> m_entries;     // most recently used first
+    std::size_t m_budgetBytes;
+    std::size_t m_bytes = 0;
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+
+    Entry *find(const FilterCacheKey &key, bool gray);
+    void insert(Entry entry);
+};
+
+#endif // FILTERCACHE_H
@@ -0,0 +1,125 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+Kernel::Kernel(std::span<const float> taps) : m_size(taps.size()), m_fixedPoint(quantizeKernel(taps)) {
+    assert(m_size % 2 == 1 && "kernels have a centre tap");
+    std::size_t padded = (m_size + KERNEL_PAD_FLOATS - 1) / KERNEL_PAD_FLOATS * KERNEL_PAD_FLOATS;
+    m_taps.reset(new (std::align_val_t(KERNEL_ALIGNMENT)) float[padded]());
+    std::copy(taps.begin(), taps.end(), m_taps.get());
+}
+
+namespace {
+
+void normalize(std::vector<float> &taps) {
+    float sum = 0.0f;
+    for (float tap : taps) {
+        sum += tap;
+    }
+    for (float &tap : taps) {
+        tap /= sum;
+    }
+}
+
+// The Gaussian filterBlur has always used; radii up to MAX_SPECIALIZED_RADIUS
+// come precomputed at compile time
+std::vector<float> buildGaussian(int radius) {
+    std::span<const float> fixed = fixedGaussianKernel(radius);
+    if (!fixed.empty()) {
+        return std::vector<float>(fixed.begin(), fixed.end());
+    }
+    float stddev = radius / 3.0;
+    double twoVariance = 2.0 * double(stddev) * stddev;
+    double scale = 1.0 / std::sqrt(M_PI * twoVariance);
+    std::vector<float> taps(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = 0; i < 2 * radius + 1; i++) {
+        int dx = i - radius;
+        double value = scale * std::exp(-(dx * dx) / twoVariance);
+        taps[i] = value;
+        sum += value;
+    }
+    for (float &tap : taps) {
+        tap /= sum;
+    }
+    return taps;
+}
+
+// Centred on the middle tap; a fractional support rounds the radius up, and
+// taps beyond the support weigh nothing
+std::vector<float> buildTriangle(float support) {
+    int radius = static_cast<int>(std::ceil(support));
+    std::vector<float> taps(2 * radius + 1);
+    for (int i = 0; i <= 2 * radius; i++) {
+        taps[i] = std::max(0.0f, 1.0f - std::abs(i - radius) / support);
+    }
+    normalize(taps);
+    return taps;
+}
+
+double sinc(double x) {
+    return x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+}
+
+std::vector<float> buildLanczos(float support) {
+    int radius = static_cast<int>(std::ceil(support));
+    std::vector<float> taps(2 * radius + 1);
+    for (int i = 0; i <= 2 * radius; i++) {
+        double x = (i - radius) * double(LANCZOS_LOBES) / support;
+        taps[i] = std::fabs(x) < LANCZOS_LOBES ? sinc(x) * sinc(x / LANCZOS_LOBES) : 0.0;
+    }
+    normalize(taps);
+    return taps;
+}
+
+std::vector<float> buildKernel(KernelType type, float parameter) {
+    switch (type) {
+    case KERNEL_GAUSSIAN:
+        return buildGaussian(static_cast<int>(parameter));
+    case KERNEL_TRIANGLE:
+        return buildTriangle(parameter);
+    case KERNEL_LANCZOS:
+        return buildLanczos(parameter);
+    case KERNEL_SOBEL_DERIVATIVE:
+        return std::vector<float>(SOBEL_DERIVATIVE.begin(), SOBEL_DERIVATIVE.end());
+    case KERNEL_SOBEL_SMOOTH:
+        return std::vector<float>(SOBEL_SMOOTH.begin(), SOBEL_SMOOTH.end());
+    }
+    return {1.0f};
+}
+
+} // namespace
+
+/**
+ * @brief Looks the kernel up under a shared lock; only the first request for a
+ * parameter set takes the exclusive lock to build it
+ */
+const Kernel &cachedKernel(KernelType type, float parameter) {
+    static std::shared_mutex mutex;
+    static std::map<std::pair<int, float>, std::unique_ptr<const Kernel>> kernels;
+
+    if (type == KERNEL_SOBEL_DERIVATIVE || type == KERNEL_SOBEL_SMOOTH) {
+        parameter = 0.0f;
+    }
+    parameter = std::round(parameter / KERNEL_PARAMETER_STEP) * KERNEL_PARAMETER_STEP;
+    std::pair<int, float> key{type, parameter};
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto found = kernels.find(key);
+        if (found != kernels.end()) {
+            return *found->second;
+        }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    std::unique_ptr<const Kernel> &kernel = kernels[key];
+    if (!kernel) {
+        kernel = std::make_unique<const Kernel>(buildKernel(type, parameter));
+    }
+    return *kernel;
+}
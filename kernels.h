@@ -0,0 +1,76 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include "convolve.h"
+
+/**
+ * Process-wide cache of 1D convolution kernels.
+ *
+ * Each kernel is built once per parameter set, the first time any thread asks
+ * for it, together with its fixed-point quantization, and then shared by every
+ * filter call on every thread for the rest of the process. Repeated filter
+ * calls pay no kernel setup at all, on either the float or the integer path.
+ * Kernels are never freed, so references stay valid. To keep them few however
+ * the parameters are computed (a triangle's support is 2 / scale, say),
+ * parameters are rounded to a multiple of KERNEL_PARAMETER_STEP first, which
+ * leaves integers alone and bounds the kernels of a type by 1 / step per unit
+ * of parameter.
+ *
+ * Taps are stored KERNEL_ALIGNMENT-aligned and zero-padded to a multiple of
+ * KERNEL_PAD_FLOATS, so vector loops can load whole registers from any tap
+ * without reading past the allocation.
+ */
+
+constexpr std::size_t KERNEL_ALIGNMENT = 64;
+constexpr std::size_t KERNEL_PAD_FLOATS = 16;
+
+// Resolution of kernel parameters; a power of two, so rounding is exact
+constexpr float KERNEL_PARAMETER_STEP = 1.0f / 64;
+
+// Lobes of the Lanczos window
+constexpr int LANCZOS_LOBES = 3;
+
+enum KernelType {
+    KERNEL_GAUSSIAN,            // parameter: radius; standard deviation radius / 3
+    KERNEL_TRIANGLE,            // parameter: support, the distance at which the weight reaches 0
+    KERNEL_LANCZOS,             // parameter: support, stretched over LANCZOS_LOBES lobes
+    KERNEL_SOBEL_DERIVATIVE,    // [-1 0 1]; no parameter
+    KERNEL_SOBEL_SMOOTH         // [1 2 1]; no parameter
+};
+
+/**
+ * @class Kernel
+ *
+ * An immutable odd-length 1D kernel in aligned, padded storage, with its
+ * quantized weights for the fixed-point path. Converts to the span of its taps.
+ */
+class Kernel {
+public:
+    explicit Kernel(std::span<const float> taps);
+
+    std::span<const float> taps() const { return {m_taps.get(), m_size}; }
+    operator std::span<const float>() const { return taps(); }
+
+    int radius() const { return static_cast<int>(m_size / 2); }
+    const FixedPointKernel &fixedPoint() const { return m_fixedPoint; }
+
+private:
+    struct AlignedDelete {
+        void operator()(float *taps) const { ::operator delete[](taps, std::align_val_t(KERNEL_ALIGNMENT)); }
+    };
+
+    std::unique_ptr<float[], AlignedDelete> m_taps;
+    std::size_t m_size = 0;
+    FixedPointKernel m_fixedPoint;
+};
+
+// The cached kernel of type for parameter (see KernelType); normalized to sum
+// to 1, except the Sobel derivative. parameter is rounded to a multiple of
+// KERNEL_PARAMETER_STEP. Thread-safe.
+const Kernel &cachedKernel(KernelType type, float parameter = 0.0f);
+
+#endif // KERNELS_H
@@ -1,11 +1,124 @@
 #include "mainwindow.h"
+#include "batch.h"
+#include "canvas2d.h"
+#include "sequence.h"
+#include "settings.h"
+#include "strokes.h"
+#include "trace.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <algorithm>
+#include <iostream>
+
+// canvas --batch <output dir> <image>... filters the images with the saved
+// filter settings, without opening a window
+static int runBatch(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    if (args.size() < 4) {
+        std::cout << "Usage: " << args[0].toStdString() << " --batch <output dir> <image>..." << std::endl;
+        return 1;
+    }
+    settings.loadSettingsOrDefaults();
+
+    BatchStats stats = runBatchFilter(args.mid(3), args[2], settings);
+    std::cout << stats.images << " images (" << stats.failed << " failed) in " << stats.seconds << " s, "
+              << stats.imagesPerSecond << " images/s, " << int(stats.utilization * 100) << "% worker utilization"
+              << std::endl;
+    return stats.failed == 0 ? 0 : 1;
+}
+
+// canvas --sequence <input pattern> <output pattern> [first frame] filters a
+// numbered frame sequence (see sequence.h) with the saved filter settings
+static int runSequence(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    if (args.size() < 4) {
+        std::cout << "Usage: " << args[0].toStdString() << " --sequence <input pattern> <output pattern> [first frame]"
+                  << std::endl;
+        return 1;
+    }
+    int firstFrame = args.size() > 4 ? args[4].toInt() : 1;
+    settings.loadSettingsOrDefaults();
+
+    std::unique_ptr<FrameFilter> filter = makeFrameFilter(settings);
+    SequenceStats stats = runSequenceFilter(args[2], args[3], firstFrame, *filter);
+    std::cout << stats.frames << " frames (" << stats.failed << " failed) in " << stats.seconds << " s, "
+              << stats.framesPerSecond << " frames/s sustained; decode " << stats.decodeSeconds << " s, filter "
+              << stats.filterSeconds << " s, encode " << stats.encodeSeconds << " s" << std::endl;
+    return stats.failed == 0 && stats.frames > 0 ? 0 : 1;
+}
+
+// canvas --replay <file.strokes> [runs] replays a stroke recording headlessly,
+// prints brush throughput and latency, and checks the result is deterministic
+static int runReplay(int argc, char *argv[]) {
+    // the canvas is a widget, but never needs a display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    QStringList args = a.arguments();
+    if (args.size() < 3) {
+        std::cout << "Usage: " << args[0].toStdString() << " --replay <file.strokes> [runs]" << std::endl;
+        return 1;
+    }
+    StrokeRecording recording;
+    if (!recording.load(args[2])) {
+        std::cout << "Failed to load stroke recording" << std::endl;
+        return 1;
+    }
+    int runs = args.size() > 3 ? std::max(2, args[3].toInt()) : 2;
+    settings.loadSettingsOrDefaults();
+
+    Canvas2D canvas;
+    canvas.setHeadless(true);
+    canvas.init();
+
+    bool deterministic = true;
+    std::uint64_t firstHash = 0;
+    for (int run = 0; run < runs; run++) {
+        ReplayStats stats = canvas.replayStrokes(recording);
+        std::cout << "run " << run + 1 << ": " << stats.events << " events, " << stats.stamps << " stamps in "
+                  << stats.seconds << " s, " << stats.stampsPerSecond << " stamps/s, latency p50 " << stats.p50Us
+                  << " us, p90 " << stats.p90Us << " us, p99 " << stats.p99Us << " us, max " << stats.maxUs
+                  << " us, hash " << std::hex << stats.hash << std::dec << std::endl;
+        if (run == 0) {
+            firstHash = stats.hash;
+        }
+        deterministic = deterministic && stats.hash == firstHash;
+    }
+
+    if (!deterministic) {
+        std::cout << "Replays produced different canvases" << std::endl;
+        return 1;
+    }
+    if (recording.finalHash != 0 && recording.finalHash != firstHash) {
+        std::cout << "Replay does not match the recorded canvas" << std::endl;
+        return 1;
+    }
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    // set CANVAS_TRACE=<file.json> to record hot-path timings for this session
+    tracer.initFromEnvironment();
+
+    int result;
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        result = runBatch(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "--sequence") {
+        result = runSequence(argc, argv);
+    } else if (argc > 1 && std::string(argv[1]) == "--replay") {
+        result = runReplay(argc, argv);
+    } else {
+        QApplication a(argc, argv);
+        MainWindow w;
+        w.show();
+        result = a.exec();
+    }
+
+    tracer.shutdown();
+    return result;
 }
@@ -9,6 +9,7 @@
 #include <QTabWidget>
 #include <QScrollArea>
 #include <QCheckBox>
+#include <QProgressBar>
 #include <iostream>
 
 MainWindow::MainWindow()
@@ -77,7 +78,10 @@ MainWindow::MainWindow()
     addRadioButton(brushLayout, "Speed", settings.brushType == BRUSH_SPEED, [this]{ setBrushType(BRUSH_SPEED); });
     addRadioButton(brushLayout, "Fill", settings.brushType == BRUSH_FILL, [this]{ setBrushType(BRUSH_FILL); });
     addRadioButton(brushLayout, "Custom", settings.brushType == BRUSH_CUSTOM, [this]{ setBrushType(BRUSH_CUSTOM); });
+    addPushButton(brushLayout, "Load stamp", &MainWindow::onLoadStampButtonClick);
+    addRadioButton(brushLayout, "Select", settings.brushType == BRUSH_SELECT, [this]{ setBrushType(BRUSH_SELECT); });
     addCheckBox(brushLayout, "Fix alpha blending", settings.fixAlphaBlending, [this](bool value){ setBoolVal(settings.fixAlphaBlending, value); });
+    addCheckBox(brushLayout, "Linear light (brushes, gaussian blur, scale)", settings.linearLight, [this](bool value){ setBoolVal(settings.linearLight, value); });
 
     // clearing canvas
     addPushButton(brushLayout, "Clear canvas", &MainWindow::onClearButtonClick);
@@ -85,17 +89,30 @@ MainWindow::MainWindow()
     // save canvas as image
     addPushButton(brushLayout, "Save Image", &MainWindow::onSaveButtonClick);
 
-    // filters
+    // stroke recording, for replaying with --replay
+    addCheckBox(brushLayout, "Record strokes", false, [this](bool value){ onRecordToggled(value); });
+
+    // filters; the border choices are in BorderMode order
+    QStringList borderModes = {"zero", "clamp", "mirror", "wrap", "zero (renormalized)"};
     addHeading(filterLayout, "Filter");
     addRadioButton(filterLayout, "Edge detect", settings.filterType == FILTER_EDGE_DETECT,  [this]{ setFilterType(FILTER_EDGE_DETECT); });
     addDoubleSpinBox(filterLayout, "sensitivity", 0.01, 1, 0.01, settings.edgeDetectSensitivity, 2, [this](float value){ setFloatVal(settings.edgeDetectSensitivity, value); });
+    addComboBox(filterLayout, "border", borderModes, settings.edgeDetectBorderMode, [this](int value){ setIntVal(settings.edgeDetectBorderMode, value); });
+    addCheckBox(filterLayout, "fixed point", settings.edgeDetectFixedPoint, [this](bool value){ setBoolVal(settings.edgeDetectFixedPoint, value); });
+    addCheckBox(filterLayout, "Canny", settings.edgeDetectCanny, [this](bool value){ setBoolVal(settings.edgeDetectCanny, value); });
 
     addRadioButton(filterLayout, "Blur", settings.filterType == FILTER_BLUR, [this]{ setFilterType(FILTER_BLUR); });
     addSpinBox(filterLayout, "radius", 0, 100, 1, settings.blurRadius, [this](int value){ setIntVal(settings.blurRadius, value); });
+    addComboBox(filterLayout, "type", {"gaussian", "box", "tilt-shift", "motion"}, settings.blurType, [this](int value){ setIntVal(settings.blurType, value); });
+    addDoubleSpinBox(filterLayout, "angle", 0, 180, 1, settings.blurAngle, 1, [this](float value){ setFloatVal(settings.blurAngle, value); });
+    addComboBox(filterLayout, "border", borderModes, settings.blurBorderMode, [this](int value){ setIntVal(settings.blurBorderMode, value); });
+    addCheckBox(filterLayout, "fixed point (gaussian)", settings.blurFixedPoint, [this](bool value){ setBoolVal(settings.blurFixedPoint, value); });
 
     addRadioButton(filterLayout, "Scale", settings.filterType == FILTER_SCALE, [this]{ setFilterType(FILTER_SCALE); });
     addDoubleSpinBox(filterLayout, "x", 0.1, 10, 0.1, settings.scaleX, 2, [this](float value){ setFloatVal(settings.scaleX, value); });
     addDoubleSpinBox(filterLayout, "y", 0.1, 10, 0.1, settings.scaleY, 2, [this](float value){ setFloatVal(settings.scaleY, value); });
+    addComboBox(filterLayout, "border", borderModes, settings.scaleBorderMode, [this](int value){ setIntVal(settings.scaleBorderMode, value); });
+    addCheckBox(filterLayout, "fixed point", settings.scaleFixedPoint, [this](bool value){ setBoolVal(settings.scaleFixedPoint, value); });
 
     // extra credit filters
     addHeading(filterLayout, "Extra Credit Filters");
@@ -117,9 +134,22 @@ MainWindow::MainWindow()
     addRadioButton(filterLayout, "Bilteral smooth", settings.filterType == FILTER_BILATERAL,  [this]{ setFilterType(FILTER_BILATERAL); });
     addSpinBox(filterLayout, "radius", 1, 100, 1, settings.bilateralRadius, [this](int value){ setIntVal(settings.bilateralRadius, value); });
 
+    // low resolution preview while tuning parameters; "Apply Filter" computes full resolution
+    addCheckBox(filterLayout, "Live preview", settings.filterPreview, [this](bool value){ setBoolVal(settings.filterPreview, value); });
+
     // filter push buttons
     addPushButton(filterLayout, "Load Image", &MainWindow::onUploadButtonClick);
     addPushButton(filterLayout, "Apply Filter", &MainWindow::onFilterButtonClick);
+
+    // filters run in the background and report progress here
+    QProgressBar *filterProgressBar = new QProgressBar();
+    filterProgressBar->setRange(0, 1);
+    filterLayout->addWidget(filterProgressBar);
+    connect(m_canvas, &Canvas2D::filterProgress, filterProgressBar, [filterProgressBar](int done, int total) {
+        filterProgressBar->setRange(0, total);
+        filterProgressBar->setValue(done);
+    });
+
     addPushButton(filterLayout, "Revert Image", &MainWindow::onRevertButtonClick);
     addPushButton(filterLayout, "Save Image", &MainWindow::onSaveButtonClick);
 }
@@ -202,6 +232,18 @@ void MainWindow::addCheckBox(QBoxLayout *layout, QString text, bool val, auto fu
     connect(box, &QCheckBox::clicked, this, function);
 }
 
+void MainWindow::addComboBox(QBoxLayout *layout, QString text, QStringList items, int val, auto function) {
+    QComboBox *box = new QComboBox();
+    box->addItems(items);
+    box->setCurrentIndex(val);
+    QHBoxLayout *subLayout = new QHBoxLayout();
+    addLabel(subLayout, text);
+    subLayout->addWidget(box);
+    layout->addLayout(subLayout);
+    connect(box, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, function);
+}
+
 
 
 // ------ FUNCTIONS FOR UPDATING SETTINGS ------
@@ -264,6 +306,25 @@ void MainWindow::onUploadButtonClick() {
     m_canvas->settingsChanged();
 }
 
+void MainWindow::onLoadStampButtonClick() {
+    QString file = QFileDialog::getOpenFileName(this, tr("Open Brush Stamp"), QDir::homePath(), tr("Image Files (*.png *.jpg *.jpeg)"));
+    if (file.isEmpty()) { return; }
+    if (m_canvas->loadBrushStamp(file)) {
+        settings.brushStampPath = file;
+        m_canvas->settingsChanged();
+    }
+}
+
+void MainWindow::onRecordToggled(bool recording) {
+    if (recording) {
+        m_canvas->startRecording();
+        return;
+    }
+    // an empty file name (dialog cancelled) discards the recording
+    QString file = QFileDialog::getSaveFileName(this, tr("Save Strokes"), QDir::currentPath(), tr("Stroke Recordings (*.strokes)"));
+    m_canvas->stopRecording(file);
+}
+
 void MainWindow::onSaveButtonClick() {
     // Get new image path selected by user
     QString file = QFileDialog::getSaveFileName(this, tr("Save Image"), QDir::currentPath(), tr("Image Files (*.png *.jpg *.jpeg)"));
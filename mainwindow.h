@@ -9,6 +9,7 @@
 #include <QDoubleSpinBox>
 #include <QLabel>
 #include <QPushButton>
+#include <QComboBox>
 #include <QBoxLayout>
 
 #include "canvas2d.h"
@@ -31,6 +32,7 @@ private:
     void addDoubleSpinBox(QBoxLayout *layout, QString text, double min, double max, double step, double val, int decimal, auto function);
     void addPushButton(QBoxLayout *layout, QString text, auto function);
     void addCheckBox(QBoxLayout *layout, QString text, bool value, auto function);
+    void addComboBox(QBoxLayout *layout, QString text, QStringList items, int val, auto function);
 
 private slots:
     void setBrushType(int type);
@@ -46,5 +48,7 @@ private slots:
     void onRevertButtonClick();
     void onUploadButtonClick();
     void onSaveButtonClick();
+    void onLoadStampButtonClick();
+    void onRecordToggled(bool recording);
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,132 @@
+#include "pyramid.h"
+#include <algorithm>
+#include <cmath>
+#include "threadpool.h"
+#include "trace.h"
+
+void DisplayPyramid::reset(int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_levels.clear();
+    int levelWidth = width;
+    int levelHeight = height;
+    while (levelWidth > MIN_LEVEL_SIZE || levelHeight > MIN_LEVEL_SIZE) {
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+        m_levels.push_back(Level{levelWidth, levelHeight, std::vector<RGBA>(size_t(levelWidth) * levelHeight)});
+    }
+
+    m_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    m_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    m_dirty.assign(size_t(m_tilesX) * m_tilesY, 0);
+    markAllDirty();
+}
+
+void DisplayPyramid::markDirty(int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, m_width);
+    y1 = std::min(y1, m_height);
+    if (x0 >= x1 || y0 >= y1 || m_levels.empty()) {
+        return;
+    }
+    for (int ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++) {
+        for (int tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++) {
+            m_dirty[ty * m_tilesX + tx] = 1;
+        }
+    }
+    m_anyDirty = true;
+}
+
+void DisplayPyramid::markAllDirty() {
+    std::fill(m_dirty.begin(), m_dirty.end(), 1);
+    m_anyDirty = !m_levels.empty();
+}
+
+// Box-filters the 2x2 source blocks under dst pixels [x0, x1) x [y0, y1); odd
+// source edges repeat their last row or column
+static void downsampleRegion(const RGBA *src, int srcWidth, int srcHeight, RGBA *dst, int dstWidth,
+                             int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const RGBA *row0 = src + size_t(2 * y) * srcWidth;
+        const RGBA *row1 = src + size_t(std::min(2 * y + 1, srcHeight - 1)) * srcWidth;
+        RGBA *out = dst + size_t(y) * dstWidth;
+        for (int x = x0; x < x1; x++) {
+            int left = 2 * x;
+            int right = std::min(2 * x + 1, srcWidth - 1);
+            out[x] = RGBA{static_cast<std::uint8_t>((row0[left].r + row0[right].r + row1[left].r + row1[right].r + 2) / 4),
+                          static_cast<std::uint8_t>((row0[left].g + row0[right].g + row1[left].g + row1[right].g + 2) / 4),
+                          static_cast<std::uint8_t>((row0[left].b + row0[right].b + row1[left].b + row1[right].b + 2) / 4),
+                          static_cast<std::uint8_t>((row0[left].a + row0[right].a + row1[left].a + row1[right].a + 2) / 4)};
+        }
+    }
+}
+
+/**
+ * @brief Recomputes, level by level, the tiles of each level that cover a dirty
+ * canvas tile. Level n tiles are TILE_SIZE pixels of level n, so each covers
+ * 2^n x 2^n canvas tiles and no two overlap; they are refreshed in parallel.
+ */
+void DisplayPyramid::refresh(const std::vector<RGBA> &canvas) {
+    if (!m_anyDirty) {
+        return;
+    }
+    TRACE_SCOPE("refreshPyramid");
+
+    std::vector<int> tiles;
+    for (int level = 1; level < levelCount(); level++) {
+        Level &target = m_levels[level - 1];
+        const RGBA *src = levelData(level - 1, canvas);
+        int srcWidth = levelWidth(level - 1);
+        int srcHeight = levelHeight(level - 1);
+        int levelTilesX = (target.width + TILE_SIZE - 1) / TILE_SIZE;
+        int levelTilesY = (target.height + TILE_SIZE - 1) / TILE_SIZE;
+
+        // level tiles covering at least one dirty canvas tile, each listed once
+        std::vector<std::uint8_t> levelDirty(size_t(levelTilesX) * levelTilesY, 0);
+        tiles.clear();
+        for (int ty = 0; ty < m_tilesY; ty++) {
+            for (int tx = 0; tx < m_tilesX; tx++) {
+                if (!m_dirty[ty * m_tilesX + tx]) {
+                    continue;
+                }
+                int index = (ty >> level) * levelTilesX + (tx >> level);
+                if (!levelDirty[index]) {
+                    levelDirty[index] = 1;
+                    tiles.push_back(index);
+                }
+            }
+        }
+
+        RGBA *dst = target.data.data();
+        ThreadPool::instance().parallelFor(0, static_cast<int>(tiles.size()), [&](int i) {
+            int tx = tiles[i] % levelTilesX;
+            int ty = tiles[i] / levelTilesX;
+            downsampleRegion(src, srcWidth, srcHeight, dst, target.width, tx * TILE_SIZE, ty * TILE_SIZE,
+                             std::min((tx + 1) * TILE_SIZE, target.width), std::min((ty + 1) * TILE_SIZE, target.height));
+        });
+    }
+
+    std::fill(m_dirty.begin(), m_dirty.end(), 0);
+    m_anyDirty = false;
+}
+
+int DisplayPyramid::levelFor(float zoom) const {
+    if (zoom >= 1.0f) {
+        return 0;
+    }
+    int level = static_cast<int>(std::floor(std::log2(1.0f / zoom)));
+    return std::clamp(level, 0, levelCount() - 1);
+}
+
+int DisplayPyramid::levelWidth(int level) const {
+    return level == 0 ? m_width : m_levels[level - 1].width;
+}
+
+int DisplayPyramid::levelHeight(int level) const {
+    return level == 0 ? m_height : m_levels[level - 1].height;
+}
+
+const RGBA *DisplayPyramid::levelData(int level, const std::vector<RGBA> &canvas) const {
+    return level == 0 ? canvas.data() : m_levels[level - 1].data.data();
+}
@@ -0,0 +1,61 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <cstdint>
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @class DisplayPyramid
+ *
+ * Mip levels of the canvas for zoomed-out display. Level 0 is the canvas
+ * itself and is not copied; level n is level n - 1 box-filtered to half size,
+ * down to the first level that fits in MIN_LEVEL_SIZE.
+ *
+ * Changes are tracked as dirty TILE_SIZE x TILE_SIZE tiles of the canvas.
+ * refresh() recomputes only the parts of each level those tiles cover, so a
+ * brush dab costs a few small downsamples no matter how large the canvas is.
+ */
+class DisplayPyramid {
+public:
+    static constexpr int TILE_SIZE = 64;
+    static constexpr int MIN_LEVEL_SIZE = 256;
+
+    // Sizes the levels for a width x height canvas and marks everything dirty
+    void reset(int width, int height);
+
+    // Marks the canvas pixels in [x0, x1) x [y0, y1) as changed
+    void markDirty(int x0, int y0, int x1, int y1);
+    void markAllDirty();
+
+    // Brings every level up to date with canvas (the level 0 data)
+    void refresh(const std::vector<RGBA> &canvas);
+
+    // Number of levels including level 0
+    int levelCount() const { return static_cast<int>(m_levels.size()) + 1; }
+
+    // The coarsest level that still has at least one pixel per screen pixel at zoom
+    int levelFor(float zoom) const;
+
+    int levelWidth(int level) const;
+    int levelHeight(int level) const;
+    const RGBA *levelData(int level, const std::vector<RGBA> &canvas) const;
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        std::vector<RGBA> data;
+    };
+
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Level> m_levels;            // level 1 and up
+
+    int m_tilesX = 0;
+    int m_tilesY = 0;
+    std::vector<std::uint8_t> m_dirty;      // per canvas tile
+    bool m_anyDirty = false;
+};
+
+#endif // PYRAMID_H
@@ -0,0 +1,185 @@
+#include "region.h"
+#include <algorithm>
+#include "blend.h"
+#include "canny.h"
+#include "threadpool.h"
+#include "trace.h"
+
+PixelRect PixelRect::clipped(int width, int height) const {
+    return PixelRect{std::clamp(x0, 0, width), std::clamp(y0, 0, height),
+                     std::clamp(x1, 0, width), std::clamp(y1, 0, height)};
+}
+
+FilterRegion FilterRegion::translated(int dx, int dy) const {
+    FilterRegion moved = *this;
+    moved.bounds = PixelRect{bounds.x0 + dx, bounds.y0 + dy, bounds.x1 + dx, bounds.y1 + dy};
+    return moved;
+}
+
+int filterHalo(const Settings &params) {
+    switch (params.filterType) {
+    case FILTER_BLUR:
+        if (params.blurType == BLUR_TILT_SHIFT) {
+            return REGION_WHOLE_IMAGE;
+        }
+        if ((params.blurType == BLUR_GAUSSIAN || params.blurType == BLUR_MOTION) && params.blurBorderMode == BORDER_WRAP) {
+            return REGION_WHOLE_IMAGE;
+        }
+        // a horizontal then a vertical pass of radius blurRadius, a box of it,
+        // or a line of it in any direction
+        return params.blurRadius;
+    case FILTER_EDGE_DETECT:
+        if (params.edgeDetectBorderMode == BORDER_WRAP) {
+            return REGION_WHOLE_IMAGE;
+        }
+        // Canny: the smoothing, the Sobel taps and the neighbours suppression
+        // compares against. Hysteresis follows edges out of any halo, so edges
+        // are only traced as far as the crop reaches.
+        return params.edgeDetectCanny ? CANNY_HALO : 1;
+    case FILTER_SCALE:
+        return REGION_WHOLE_IMAGE;
+    default:
+        // per-pixel filters; tone mapping takes its levels from the whole image
+        return 0;
+    }
+}
+
+bool filterRunsOnCrop(const Settings &params) {
+    return filterHalo(params) != REGION_WHOLE_IMAGE;
+}
+
+Image cropImage(const RGBA *data, int width, const PixelRect &rect, BufferPool &pool) {
+    Image crop{rect.width(), rect.height(), pool.take(std::size_t(rect.width()) * rect.height())};
+    for (int y = rect.y0; y < rect.y1; y++) {
+        const RGBA *row = data + std::size_t(y) * width;
+        std::copy(row + rect.x0, row + rect.x1, crop.data.begin() + std::size_t(y - rect.y0) * crop.width);
+    }
+    return crop;
+}
+
+namespace {
+
+// True if any pixel of tile is (partly) selected
+bool tileSelected(const FilterRegion &region, const PixelRect &tile) {
+    if (region.mask.empty()) {
+        return true;
+    }
+    for (int y = tile.y0; y < tile.y1; y++) {
+        const std::uint8_t *row = &region.mask[std::size_t(y - region.bounds.y0) * region.bounds.width()];
+        if (std::any_of(row + (tile.x0 - region.bounds.x0), row + (tile.x1 - region.bounds.x0),
+                        [](std::uint8_t coverage) { return coverage != 0; })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Blends the pixels of filtered, whose top left corner sits at origin in
+// image, over image within rect, weighted by region's coverage
+void blendUnderMask(Image &image, const Image &filtered, int originX, int originY, const FilterRegion &region,
+                    const PixelRect &rect) {
+    for (int y = rect.y0; y < rect.y1; y++) {
+        RGBA *out = &image.data[std::size_t(y) * image.width];
+        const RGBA *in = &filtered.data[std::size_t(y - originY) * filtered.width];
+        for (int x = rect.x0; x < rect.x1; x++) {
+            std::uint32_t coverage = region.coverage(x, y);
+            const RGBA &pixel = in[x - originX];
+            if (coverage == 255) {
+                out[x] = pixel;
+            } else if (coverage != 0) {
+                std::uint32_t keep = 255 - coverage;
+                out[x] = RGBA{std::uint8_t(div255(out[x].r * keep + pixel.r * coverage)),
+                              std::uint8_t(div255(out[x].g * keep + pixel.g * coverage)),
+                              std::uint8_t(div255(out[x].b * keep + pixel.b * coverage)),
+                              std::uint8_t(div255(out[x].a * keep + pixel.a * coverage))};
+            }
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Splits the selected area into runs of tiles, filters each run's crop
+ * (with its halo) on the pool, then blends the runs back. Runs are only
+ * written back once every run has been cropped, since their halos overlap
+ * their neighbours.
+ */
+bool applyFilterRegion(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                       const FilterRegion &region, const ImageStats *stats, const GrayImage *gray) {
+    if (region.empty() || params.filterType == FILTER_SCALE) {
+        return applyFilter(image, params, pool, progress, stats, gray);
+    }
+    TRACE_SCOPE("applyFilterRegion");
+    PixelRect area = region.bounds.clipped(image.width, image.height);
+    if (area.empty()) {
+        return true;
+    }
+
+    int halo = filterHalo(params);
+    if (halo == REGION_WHOLE_IMAGE) {
+        Image filtered{image.width, image.height, pool.take(image.data.size())};
+        std::copy(image.data.begin(), image.data.end(), filtered.data.begin());
+        bool completed = applyFilter(filtered, params, pool, progress, stats, gray);
+        if (completed) {
+            blendUnderMask(image, filtered, 0, 0, region, area);
+        }
+        pool.give(std::move(filtered.data));
+        return completed;
+    }
+
+    // tone mapping levels come from the whole image, not from each crop
+    ImageStats imageStats;
+    if (params.filterType == FILTER_MAPPING && !stats) {
+        imageStats = computeImageStats(image.data.data(), image.data.size());
+        stats = &imageStats;
+    }
+
+    // runs of consecutive selected tiles along each row of tiles
+    int tileSize = std::max(REGION_TILE_SIZE, 4 * halo);
+    std::vector<PixelRect> runs;
+    for (int tileY = area.y0; tileY < area.y1; tileY += tileSize) {
+        int tileBottom = std::min(tileY + tileSize, area.y1);
+        int runStart = -1;
+        for (int tileX = area.x0; tileX < area.x1; tileX += tileSize) {
+            int tileRight = std::min(tileX + tileSize, area.x1);
+            bool selected = tileSelected(region, PixelRect{tileX, tileY, tileRight, tileBottom});
+            if (selected && runStart < 0) {
+                runStart = tileX;
+            } else if (!selected && runStart >= 0) {
+                runs.push_back(PixelRect{runStart, tileY, tileX, tileBottom});
+                runStart = -1;
+            }
+        }
+        if (runStart >= 0) {
+            runs.push_back(PixelRect{runStart, tileY, area.x1, tileBottom});
+        }
+    }
+
+    progress.stripsTotal = static_cast<int>(runs.size());
+    std::vector<PixelRect> crops(runs.size());
+    std::vector<Image> filtered(runs.size());
+    ThreadPool::instance().parallelFor(0, static_cast<int>(runs.size()), [&](int i) {
+        if (progress.isCancelled()) {
+            return;
+        }
+        crops[i] = runs[i].expanded(halo).clipped(image.width, image.height);
+        filtered[i] = cropImage(image.data.data(), image.width, crops[i], pool);
+        // counted in runs rather than strips, but cancelled with the whole
+        FilterProgress runProgress;
+        runProgress.parent = &progress;
+        applyFilter(filtered[i], params, pool, runProgress, stats);
+        progress.stripsDone.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    bool completed = !progress.isCancelled();
+    if (completed) {
+        ThreadPool::instance().parallelFor(0, static_cast<int>(runs.size()), [&](int i) {
+            blendUnderMask(image, filtered[i], crops[i].x0, crops[i].y0, region, runs[i]);
+        });
+    }
+    for (Image &run : filtered) {
+        pool.give(std::move(run.data));
+    }
+    return completed;
+}
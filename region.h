@@ -0,0 +1,86 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <cstdint>
+#include <vector>
+#include "bufferpool.h"
+#include "filter.h"
+#include "settings.h"
+
+/**
+ * Region-of-interest filtering.
+ *
+ * A FilterRegion is a rectangle, optionally with an 8-bit coverage mask over
+ * it. Filtering a region only computes the tiles of the image that intersect
+ * it: each run of selected tiles along a tile row is cropped out together with
+ * the halo of pixels the filter reads around its output (filterHalo()),
+ * filtered on its own, and blended back under the mask. The work is then
+ * proportional to the selection rather than to the image.
+ *
+ * Filters that look at the whole image to produce any pixel (tilt-shift, whose
+ * sharp band is placed by the image height, or passes with BORDER_WRAP) have no
+ * halo; those run over the whole image and are then blended back under the
+ * mask the same way. Scaling changes the image size and ignores the region.
+ */
+
+// Tile edge length runs are built from; grown for large halos so that the
+// halo stays a small fraction of the pixels a run crops
+constexpr int REGION_TILE_SIZE = 128;
+
+// filterHalo() of filters that cannot run on a crop
+constexpr int REGION_WHOLE_IMAGE = -1;
+
+// [x0, x1) x [y0, y1) in image pixels
+struct PixelRect {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+
+    PixelRect expanded(int margin) const { return PixelRect{x0 - margin, y0 - margin, x1 + margin, y1 + margin}; }
+    PixelRect clipped(int width, int height) const;
+
+    bool operator==(const PixelRect &other) const = default;
+};
+
+struct FilterRegion {
+    PixelRect bounds;
+    // Empty for the whole rectangle, otherwise bounds.width() x bounds.height()
+    // coverage values, 255 taking the filtered pixel and 0 keeping the original
+    std::vector<std::uint8_t> mask;
+
+    bool empty() const { return bounds.empty(); }
+
+    std::uint8_t coverage(int x, int y) const {
+        return mask.empty() ? 255 : mask[std::size_t(y - bounds.y0) * bounds.width() + (x - bounds.x0)];
+    }
+
+    // The same region with its origin moved by (dx, dy)
+    FilterRegion translated(int dx, int dy) const;
+};
+
+// How far outside an output pixel the filter params selects reads, summed over
+// its passes, or REGION_WHOLE_IMAGE
+int filterHalo(const Settings &params);
+
+// True if filtering region of an image can skip the pixels outside it and its
+// halo, i.e. the filter is neither whole-image nor changes the image size
+bool filterRunsOnCrop(const Settings &params);
+
+// The rect of data (width pixels per row) in a buffer from pool
+Image cropImage(const RGBA *data, int width, const PixelRect &rect, BufferPool &pool);
+
+// Applies the filter selected in params to the part of image under region, in
+// place, and blends it back under region's mask; pixels outside region keep
+// their values. An empty region filters the whole image, as applyFilter()
+// does. Progress counts filtered runs. Returns false if cancelled. gray, the
+// luminance of the whole image, is only used by filters that run on all of it.
+bool applyFilterRegion(Image &image, const Settings &params, BufferPool &pool, FilterProgress &progress,
+                       const FilterRegion &region, const ImageStats *stats = nullptr,
+                       const GrayImage *gray = nullptr);
+
+#endif // REGION_H
@@ -0,0 +1,136 @@
+#include "sat.h"
+#include <algorithm>
+#include <cmath>
+#include "threadpool.h"
+#include "trace.h"
+
+// Columns each task of the vertical pass sums down; wide enough that every
+// row step touches whole cache lines
+constexpr int SAT_COLUMN_BLOCK = 64;
+
+void SummedAreaTable::build(const Image &image, FilterProgress &progress) {
+    TRACE_SCOPE("buildSummedAreaTable");
+    m_width = image.width;
+    m_height = image.height;
+    size_t stride = size_t(m_width + 1) * 3;
+    m_sums.assign(stride * (m_height + 1), 0);
+
+    // prefix sums along each row; row y of the image is table row y + 1
+    forEachStrip(m_height, progress, [&](int rowBegin, int rowEnd) {
+        for (int y = rowBegin; y < rowEnd; y++) {
+            const RGBA *in = &image.data[size_t(y) * m_width];
+            std::uint64_t *out = &m_sums[(y + 1) * stride];
+            std::uint64_t red = 0;
+            std::uint64_t green = 0;
+            std::uint64_t blue = 0;
+            for (int x = 0; x < m_width; x++) {
+                red += in[x].r;
+                green += in[x].g;
+                blue += in[x].b;
+                out[3 * (x + 1)] = red;
+                out[3 * (x + 1) + 1] = green;
+                out[3 * (x + 1) + 2] = blue;
+            }
+        }
+    });
+    if (progress.isCancelled()) {
+        return;
+    }
+
+    // then down each column, a block of columns per task
+    int blocks = (m_width + SAT_COLUMN_BLOCK - 1) / SAT_COLUMN_BLOCK;
+    ThreadPool::instance().parallelFor(0, blocks, [&](int block) {
+        size_t begin = 3 * (size_t(block) * SAT_COLUMN_BLOCK + 1);
+        size_t end = 3 * (std::min<size_t>(size_t(block + 1) * SAT_COLUMN_BLOCK, m_width) + 1);
+        for (int y = 2; y <= m_height; y++) {
+            const std::uint64_t *above = &m_sums[(y - 1) * stride];
+            std::uint64_t *row = &m_sums[y * stride];
+            for (size_t i = begin; i < end; i++) {
+                row[i] += above[i];
+            }
+        }
+    });
+}
+
+std::array<std::uint64_t, 3> SummedAreaTable::sum(int x0, int y0, int x1, int y1) const {
+    x0 = std::clamp(x0, 0, m_width);
+    x1 = std::clamp(x1, x0, m_width);
+    y0 = std::clamp(y0, 0, m_height);
+    y1 = std::clamp(y1, y0, m_height);
+    size_t stride = size_t(m_width + 1) * 3;
+    const std::uint64_t *top = &m_sums[y0 * stride];
+    const std::uint64_t *bottom = &m_sums[y1 * stride];
+    std::array<std::uint64_t, 3> sums;
+    for (int channel = 0; channel < 3; channel++) {
+        sums[channel] = bottom[3 * x1 + channel] - bottom[3 * x0 + channel] - top[3 * x1 + channel] + top[3 * x0 + channel];
+    }
+    return sums;
+}
+
+RGBA SummedAreaTable::mean(int x0, int y0, int x1, int y1) const {
+    std::uint64_t area = std::uint64_t(std::clamp(x1, 0, m_width) - std::clamp(x0, 0, m_width)) *
+                         (std::clamp(y1, 0, m_height) - std::clamp(y0, 0, m_height));
+    if (x1 <= x0 || y1 <= y0 || area == 0) {
+        return RGBA{0, 0, 0, 255};
+    }
+    std::array<std::uint64_t, 3> sums = sum(x0, y0, x1, y1);
+    return RGBA{std::uint8_t((sums[0] + area / 2) / area), std::uint8_t((sums[1] + area / 2) / area),
+                std::uint8_t((sums[2] + area / 2) / area), 255};
+}
+
+// Replaces each pixel with the box mean at radiusAt(x, y), blending the two
+// nearest integer radii for fractional ones
+template <class RadiusAt>
+static void blurWithRadius(Image &image, RadiusAt radiusAt, FilterProgress &progress) {
+    SummedAreaTable table;
+    table.build(image, progress);
+
+    forEachStrip(image.height, progress, [&](int rowBegin, int rowEnd) {
+        for (int y = rowBegin; y < rowEnd; y++) {
+            for (int x = 0; x < image.width; x++) {
+                float radius = std::max(0.0f, radiusAt(x, y));
+                int lower = static_cast<int>(radius);
+                float fraction = radius - lower;
+                RGBA &pixel = image.data[size_t(y) * image.width + x];
+                RGBA smaller = table.boxMean(x, y, lower);
+                if (fraction < 1.0f / 256) {
+                    pixel = RGBA{smaller.r, smaller.g, smaller.b, pixel.a};
+                    continue;
+                }
+                RGBA larger = table.boxMean(x, y, lower + 1);
+                pixel = RGBA{clamp(smaller.r + fraction * (larger.r - smaller.r)),
+                             clamp(smaller.g + fraction * (larger.g - smaller.g)),
+                             clamp(smaller.b + fraction * (larger.b - smaller.b)), pixel.a};
+            }
+        }
+    });
+}
+
+void filterBoxBlur(Image &image, int radius, FilterProgress &progress) {
+    TRACE_SCOPE("filterBoxBlur");
+    if (radius == 0) {
+        return;
+    }
+    blurWithRadius(image, [radius](int, int) { return float(radius); }, progress);
+}
+
+void filterVariableBlur(Image &image, const std::vector<float> &radii, FilterProgress &progress) {
+    TRACE_SCOPE("filterVariableBlur");
+    blurWithRadius(image, [&](int x, int y) { return radii[size_t(y) * image.width + x]; }, progress);
+}
+
+void filterTiltShift(Image &image, int maxRadius, FilterProgress &progress) {
+    TRACE_SCOPE("filterTiltShift");
+    if (maxRadius == 0) {
+        return;
+    }
+    // sharp within an eighth of the height of the centre line, fully blurred
+    // from three eighths out
+    float centre = (image.height - 1) / 2.0f;
+    float sharp = image.height / 8.0f;
+    float ramp = image.height / 4.0f;
+    blurWithRadius(image, [&](int, int y) {
+        float distance = std::fabs(y - centre) - sharp;
+        return maxRadius * std::clamp(distance / ramp, 0.0f, 1.0f);
+    }, progress);
+}
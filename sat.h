@@ -0,0 +1,56 @@
+#ifndef SAT_H
+#define SAT_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "filter.h"
+
+/**
+ * @class SummedAreaTable
+ *
+ * Integral image of the r, g and b channels: entry (x, y) holds the sums over
+ * every pixel above and to the left of (x, y), so the sum over any rectangle
+ * is four lookups no matter its size. Box means, and blurs whose radius varies
+ * per pixel, then cost the same at every radius.
+ *
+ * Sums are 64-bit, which is exact for any image that fits in memory (32 bits
+ * would overflow past 4096 x 4096 white pixels). The table is built with two
+ * parallel prefix-sum passes: along each row, with rows split across the pool,
+ * then down each column, with columns split across it.
+ */
+class SummedAreaTable {
+public:
+    void build(const Image &image, FilterProgress &progress);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Channel sums over [x0, x1) x [y0, y1), clipped to the image
+    std::array<std::uint64_t, 3> sum(int x0, int y0, int x1, int y1) const;
+
+    // Mean color over the part of [x0, x1) x [y0, y1) inside the image, i.e.
+    // edges are handled as BORDER_ZERO_RENORMALIZED; alpha is 255
+    RGBA mean(int x0, int y0, int x1, int y1) const;
+
+    // Mean of the (2 radius + 1)^2 window centred on (x, y)
+    RGBA boxMean(int x, int y, int radius) const { return mean(x - radius, y - radius, x + radius + 1, y + radius + 1); }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<std::uint64_t> m_sums;   // (width + 1) x (height + 1) x 3, first row and column zero
+};
+
+// Box blur of the given radius
+void filterBoxBlur(Image &image, int radius, FilterProgress &progress);
+
+// Blurs each pixel with a box of its own radius from radii (one per pixel).
+// Fractional radii blend the two nearest integer boxes.
+void filterVariableBlur(Image &image, const std::vector<float> &radii, FilterProgress &progress);
+
+// Depth-of-field style blur: sharp in a band across the middle of the image,
+// ramping up to maxRadius at the top and bottom edges
+void filterTiltShift(Image &image, int maxRadius, FilterProgress &progress);
+
+#endif // SAT_H
@@ -0,0 +1,295 @@
+#include "separable.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "trace.h"
+
+namespace {
+
+// Singular triplets of a square matrix, largest first
+struct Decomposition {
+    std::vector<double> values;
+    std::vector<std::vector<double>> left;      // u_i, over rows
+    std::vector<std::vector<double>> right;     // v_i, over columns
+};
+
+/**
+ * @brief One-sided Jacobi SVD: rotates pairs of columns of A until they are
+ * orthogonal, accumulating the rotations in V. Then A V = U Sigma, with the
+ * column norms as singular values.
+ */
+Decomposition decompose(std::span<const float> kernel, int n) {
+    // column-major copies, so each rotation walks contiguous memory
+    std::vector<double> a(size_t(n) * n);
+    std::vector<double> v(size_t(n) * n, 0.0);
+    for (int row = 0; row < n; row++) {
+        for (int col = 0; col < n; col++) {
+            a[size_t(col) * n + row] = kernel[row * n + col];
+        }
+        v[size_t(row) * n + row] = 1.0;
+    }
+
+    constexpr int MAX_SWEEPS = 60;
+    for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+        bool rotated = false;
+        for (int p = 0; p < n - 1; p++) {
+            for (int q = p + 1; q < n; q++) {
+                double *ap = &a[size_t(p) * n];
+                double *aq = &a[size_t(q) * n];
+                double alpha = 0.0;
+                double beta = 0.0;
+                double gamma = 0.0;
+                for (int i = 0; i < n; i++) {
+                    alpha += ap[i] * ap[i];
+                    beta += aq[i] * aq[i];
+                    gamma += ap[i] * aq[i];
+                }
+                if (std::fabs(gamma) <= 1e-15 * std::sqrt(alpha * beta) || gamma == 0.0) {
+                    continue;
+                }
+                rotated = true;
+                double zeta = (beta - alpha) / (2.0 * gamma);
+                double t = std::copysign(1.0, zeta) / (std::fabs(zeta) + std::sqrt(1.0 + zeta * zeta));
+                double c = 1.0 / std::sqrt(1.0 + t * t);
+                double s = c * t;
+                double *vp = &v[size_t(p) * n];
+                double *vq = &v[size_t(q) * n];
+                for (int i = 0; i < n; i++) {
+                    double x = ap[i];
+                    double y = aq[i];
+                    ap[i] = c * x - s * y;
+                    aq[i] = s * x + c * y;
+                    x = vp[i];
+                    y = vq[i];
+                    vp[i] = c * x - s * y;
+                    vq[i] = s * x + c * y;
+                }
+            }
+        }
+        if (!rotated) {
+            break;
+        }
+    }
+
+    std::vector<double> norms(n);
+    for (int col = 0; col < n; col++) {
+        const double *column = &a[size_t(col) * n];
+        norms[col] = std::sqrt(std::inner_product(column, column + n, column, 0.0));
+    }
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int x, int y) { return norms[x] > norms[y]; });
+
+    Decomposition result;
+    for (int col : order) {
+        if (norms[col] == 0.0) {
+            break;
+        }
+        std::vector<double> u(n);
+        for (int i = 0; i < n; i++) {
+            u[i] = a[size_t(col) * n + i] / norms[col];
+        }
+        result.values.push_back(norms[col]);
+        result.left.push_back(std::move(u));
+        result.right.emplace_back(v.begin() + size_t(col) * n, v.begin() + size_t(col + 1) * n);
+    }
+    return result;
+}
+
+// Sum of the valid taps of a 1D kernel centered on each position of [0, limit),
+// i.e. how much weight a BORDER_ZERO pass actually applies there
+std::vector<float> usedWeights(const std::vector<float> &kernel, int limit, BorderMode border) {
+    int radius = static_cast<int>(kernel.size()) / 2;
+    std::vector<float> used(limit, 0.0f);
+    for (int i = 0; i < limit; i++) {
+        for (int k = 0; k < static_cast<int>(kernel.size()); k++) {
+            if (borderIndex(i + k - radius, limit, border) >= 0) {
+                used[i] += kernel[k];
+            }
+        }
+    }
+    return used;
+}
+
+} // namespace
+
+SeparableKernel separateKernel(std::span<const float> kernel, float tolerance, int maxTerms) {
+    TRACE_SCOPE("separateKernel");
+    int n = std::sqrt(kernel.size());
+    SeparableKernel separable;
+    if (n == 0 || maxTerms <= 0) {
+        return separable;
+    }
+    Decomposition svd = decompose(kernel, n);
+
+    // what the terms kept so far still leave out
+    std::vector<double> residual(kernel.begin(), kernel.end());
+    auto errorBound = [&] {
+        double l1 = 0.0;
+        for (double value : residual) {
+            l1 += std::fabs(value);
+        }
+        return static_cast<float>(255.0 * l1);
+    };
+
+    separable.errorBound = errorBound();
+    for (size_t term = 0; term < svd.values.size() && separable.errorBound > tolerance; term++) {
+        if (static_cast<int>(term) == maxTerms) {
+            return SeparableKernel{};
+        }
+        std::vector<double> &u = svd.left[term];
+        std::vector<double> &v = svd.right[term];
+
+        // flip both factors so the horizontal one sums to >= 0, and give it an
+        // L1 norm of 1; a non-negative horizontal factor then sums to 1 and its
+        // pass cannot overflow a byte
+        double sum = std::accumulate(v.begin(), v.end(), 0.0);
+        double l1 = 0.0;
+        for (double x : v) {
+            l1 += std::fabs(x);
+        }
+        double scale = (sum < 0.0 ? -1.0 : 1.0) / l1;
+
+        SeparableTerm separableTerm;
+        for (int i = 0; i < n; i++) {
+            separableTerm.horizontal.push_back(static_cast<float>(v[i] * scale));
+            separableTerm.vertical.push_back(static_cast<float>(u[i] * svd.values[term] / scale));
+        }
+        for (int row = 0; row < n; row++) {
+            for (int col = 0; col < n; col++) {
+                residual[row * n + col] -= double(separableTerm.vertical[row]) * separableTerm.horizontal[col];
+            }
+        }
+        separable.terms.push_back(std::move(separableTerm));
+        separable.errorBound = errorBound();
+    }
+    if (separable.errorBound > tolerance) {
+        return SeparableKernel{};
+    }
+    return separable;
+}
+
+int maxSeparableTerms(int kernelLen) {
+    // a fused term recomputes the horizontal pass for the radius-high halo of
+    // each strip, so it costs kernelLen taps for the vertical pass and about
+    // kernelLen * (1 + 2 radius / FILTER_STRIP_ROWS) for the horizontal one
+    int radius = kernelLen / 2;
+    int tapsPerTerm = kernelLen * (2 * FILTER_STRIP_ROWS + 2 * radius) / FILTER_STRIP_ROWS;
+    return (kernelLen * kernelLen - 1) / std::max(1, tapsPerTerm);
+}
+
+void convolveSeparable(const SeparableKernel &separable, const Image &image, std::vector<RGBA> &result,
+                       const ConvolveOptions &options, FilterProgress &progress) {
+    if (separable.terms.size() == 1 &&
+        *std::min_element(separable.terms[0].horizontal.begin(), separable.terms[0].horizontal.end()) >= -1e-6f) {
+        std::vector<RGBA> pass1;
+        progress.stripsTotal.fetch_add(stripCount(image.height), std::memory_order_relaxed);
+        convolve1DHorizontal(separable.terms[0].horizontal, image.data, pass1, image.width, image.height, options, progress);
+        convolve1DVertical(separable.terms[0].vertical, pass1, result, image.width, image.height, options, progress);
+        return;
+    }
+
+    TRACE_SCOPE("convolveSeparable");
+    result.resize(image.data.size());
+    int width = image.width;
+    int height = image.height;
+    int radius = static_cast<int>(separable.terms[0].horizontal.size()) / 2;
+    int kernelLen = 2 * radius + 1;
+
+    // the full kernel's sum and, per term, the weight each row and column
+    // actually gets, for BORDER_ZERO_RENORMALIZED
+    float kernelSum = 0.0f;
+    for (const SeparableTerm &term : separable.terms) {
+        kernelSum += std::accumulate(term.horizontal.begin(), term.horizontal.end(), 0.0f) *
+                     std::accumulate(term.vertical.begin(), term.vertical.end(), 0.0f);
+    }
+    bool renormalize = options.border == BORDER_ZERO_RENORMALIZED && std::fabs(kernelSum) > 1e-6f;
+    std::vector<std::vector<float>> usedColumns;
+    std::vector<std::vector<float>> usedRows;
+    if (renormalize) {
+        for (const SeparableTerm &term : separable.terms) {
+            usedColumns.push_back(usedWeights(term.horizontal, width, options.border));
+            usedRows.push_back(usedWeights(term.vertical, height, options.border));
+        }
+    }
+
+    int interiorLeft = std::min(radius, width);
+    int interiorRight = std::max(interiorLeft, width - radius);
+
+    forEachStrip(height, progress, [&](int rowBegin, int rowEnd) {
+        // horizontal results for the strip and its halo, then the running sum
+        thread_local std::vector<float> rows;
+        thread_local std::vector<float> accumulated;
+        int haloRows = rowEnd - rowBegin + 2 * radius;
+        rows.resize(size_t(haloRows) * width * 3);
+        accumulated.assign(size_t(rowEnd - rowBegin) * width * 3, 0.0f);
+
+        for (const SeparableTerm &term : separable.terms) {
+            const float *h = term.horizontal.data();
+            for (int hr = 0; hr < haloRows; hr++) {
+                float *out = &rows[size_t(hr) * width * 3];
+                int y = borderIndex(rowBegin - radius + hr, height, options.border);
+                if (y < 0) {
+                    std::fill(out, out + size_t(width) * 3, 0.0f);
+                    continue;
+                }
+                const RGBA *source = &image.data[size_t(y) * width];
+                for (int c = 0; c < width; c++) {
+                    float redAcc = 0.0f;
+                    float greenAcc = 0.0f;
+                    float blueAcc = 0.0f;
+                    if (c >= interiorLeft && c < interiorRight) {
+                        const RGBA *taps = source + c - radius;
+                        for (int k = 0; k < kernelLen; k++) {
+                            redAcc += h[k] * taps[k].r;
+                            greenAcc += h[k] * taps[k].g;
+                            blueAcc += h[k] * taps[k].b;
+                        }
+                    } else {
+                        for (int k = 0; k < kernelLen; k++) {
+                            int x = borderIndex(c + k - radius, width, options.border);
+                            if (x >= 0) {
+                                redAcc += h[k] * source[x].r;
+                                greenAcc += h[k] * source[x].g;
+                                blueAcc += h[k] * source[x].b;
+                            }
+                        }
+                    }
+                    out[3 * c] = redAcc;
+                    out[3 * c + 1] = greenAcc;
+                    out[3 * c + 2] = blueAcc;
+                }
+            }
+
+            const float *v = term.vertical.data();
+            for (int r = rowBegin; r < rowEnd; r++) {
+                float *acc = &accumulated[size_t(r - rowBegin) * width * 3];
+                for (int k = 0; k < kernelLen; k++) {
+                    const float *in = &rows[size_t(r - rowBegin + k) * width * 3];
+                    for (int i = 0; i < width * 3; i++) {
+                        acc[i] += v[k] * in[i];
+                    }
+                }
+            }
+        }
+
+        for (int r = rowBegin; r < rowEnd; r++) {
+            const float *acc = &accumulated[size_t(r - rowBegin) * width * 3];
+            bool borderRow = r < radius || r >= height - radius;
+            for (int c = 0; c < width; c++) {
+                float scale = 1.0f;
+                if (renormalize && (borderRow || c < interiorLeft || c >= interiorRight)) {
+                    float usedWeight = 0.0f;
+                    for (size_t t = 0; t < separable.terms.size(); t++) {
+                        usedWeight += usedRows[t][r] * usedColumns[t][c];
+                    }
+                    if (std::fabs(usedWeight) > 1e-6f) {
+                        scale = kernelSum / usedWeight;
+                    }
+                }
+                result[size_t(r) * width + c] = RGBA{clamp(acc[3 * c] * scale), clamp(acc[3 * c + 1] * scale),
+                                                     clamp(acc[3 * c + 2] * scale), 255};
+            }
+        }
+    });
+}
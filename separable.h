@@ -0,0 +1,48 @@
+#ifndef SEPARABLE_H
+#define SEPARABLE_H
+
+#include <span>
+#include <vector>
+#include "filter.h"
+
+/**
+ * SEPARABLE DECOMPOSITION
+ *
+ * Any square kernel K (row kr is the vertical offset, column kc the horizontal
+ * one) is a sum of separable terms sigma_i u_i v_i^T, given by its singular
+ * value decomposition. A term is a horizontal pass with v_i followed by a
+ * vertical pass with sigma_i u_i, which is O(k) per pixel instead of O(k^2).
+ * Keeping only the largest terms gives a low-rank approximation of K.
+ */
+
+struct SeparableTerm {
+    std::vector<float> horizontal;
+    std::vector<float> vertical;
+};
+
+struct SeparableKernel {
+    std::vector<SeparableTerm> terms;   // largest singular value first
+
+    // Most any output channel can differ from convolving with the full
+    // kernel, in levels: 255 times the L1 norm of the kernel minus the terms
+    float errorBound = 0.0f;
+};
+
+// Decomposes a square kernel by one-sided Jacobi SVD and keeps the fewest terms
+// that bring errorBound within tolerance. Returns no terms if that would take
+// more than maxTerms.
+SeparableKernel separateKernel(std::span<const float> kernel, float tolerance, int maxTerms);
+
+// The most terms for which the separable path does fewer taps per pixel than
+// a direct 2D convolution with a kernelLen x kernelLen kernel
+int maxSeparableTerms(int kernelLen);
+
+// Convolves with the sum of the terms, computing the same result as
+// convolve2DDirect with the full kernel to within errorBound plus rounding.
+// A single term whose horizontal factor is non-negative runs as the two
+// ordinary 1D passes, adding the strips of the second to progress.stripsTotal;
+// anything else runs as one fused pass over strips.
+void convolveSeparable(const SeparableKernel &separable, const Image &image, std::vector<RGBA> &output,
+                       const ConvolveOptions &options, FilterProgress &progress);
+
+#endif // SEPARABLE_H
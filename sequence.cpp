@@ -0,0 +1,191 @@
+#include "sequence.h"
+#include <QFileInfo>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include "batch.h"
+#include "trace.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A frame travelling down the pipeline; decoded is false if it could not be read
+struct Frame {
+    int index = 0;
+    bool decoded = false;
+    Image image;
+};
+
+/**
+ * @brief A FIFO of at most capacity items between two pipeline stages. push()
+ * blocks while it is full and pop() while it is empty; once closed, pop()
+ * drains what is left and then returns nothing.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : m_capacity(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [&] { return m_items.size() < m_capacity; });
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [&] { return !m_items.empty() || m_closed; });
+        if (m_items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return item;
+    }
+
+    // Called by the producer after its last push
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::size_t m_capacity;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    bool m_closed = false;
+};
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+} // namespace
+
+bool StillFrameFilter::filter(Image &frame, int, BufferPool &pool, FilterProgress &progress) {
+    return applyFilter(frame, m_params, pool, progress);
+}
+
+bool ToneMapFrameFilter::filter(Image &frame, int, BufferPool &, FilterProgress &progress) {
+    ImageStats stats = computeImageStats(frame.data.data(), frame.data.size());
+    if (m_hasLevels) {
+        m_levels.blendTowards(stats, LEVELS_ADAPTATION);
+    } else {
+        m_levels = stats;
+        m_hasLevels = true;
+    }
+    progress.stripsTotal = stripCount(frame.height);
+    filterToneMap(frame, m_params, m_levels, progress);
+    return !progress.isCancelled();
+}
+
+std::unique_ptr<FrameFilter> makeFrameFilter(const Settings &params) {
+    if (params.filterType == FILTER_MAPPING) {
+        return std::make_unique<ToneMapFrameFilter>(params);
+    }
+    return std::make_unique<StillFrameFilter>(params);
+}
+
+QString frameFileName(const QString &pattern, int index) {
+    int first = pattern.indexOf('#');
+    if (first < 0) {
+        return pattern;
+    }
+    int digits = 1;
+    while (first + digits < pattern.size() && pattern[first + digits] == '#') {
+        digits++;
+    }
+    return pattern.left(first) + QString("%1").arg(index, digits, 10, QChar('0')) + pattern.mid(first + digits);
+}
+
+SequenceStats runSequenceFilter(const QString &inputPattern, const QString &outputPattern, int firstFrame,
+                                FrameFilter &filter) {
+    TRACE_SCOPE("runSequenceFilter");
+    BufferPool pool;
+    BoundedQueue<Frame> decoded(SEQUENCE_QUEUE_FRAMES);
+    BoundedQueue<Frame> filtered(SEQUENCE_QUEUE_FRAMES);
+    SequenceStats stats;
+    auto start = Clock::now();
+
+    std::thread decoder([&] {
+        for (int index = firstFrame;; index++) {
+            QString file = frameFileName(inputPattern, index);
+            if (!QFileInfo::exists(file)) {
+                break;
+            }
+            auto stageStart = Clock::now();
+            Frame frame;
+            frame.index = index;
+            frame.decoded = decodeImage(file, pool, frame.image);
+            if (!frame.decoded) {
+                std::cout << "Failed to load " << file.toStdString() << std::endl;
+            }
+            stats.decodeSeconds += secondsSince(stageStart);
+            decoded.push(std::move(frame));
+            // a pattern without '#' names a single frame
+            if (!inputPattern.contains('#')) {
+                break;
+            }
+        }
+        decoded.close();
+    });
+
+    std::optional<Clock::time_point> firstWritten;
+    Clock::time_point lastWritten;
+    std::thread encoder([&] {
+        while (std::optional<Frame> frame = filtered.pop()) {
+            auto stageStart = Clock::now();
+            QString output = frameFileName(outputPattern, frame->index);
+            bool written = frame->decoded && encodeImage(frame->image, output);
+            if (frame->decoded && !written) {
+                std::cout << "Failed to save " << output.toStdString() << std::endl;
+            }
+            pool.give(std::move(frame->image.data));
+            stats.encodeSeconds += secondsSince(stageStart);
+
+            if (written) {
+                stats.frames++;
+                lastWritten = Clock::now();
+                if (!firstWritten) {
+                    firstWritten = lastWritten;
+                }
+            } else {
+                stats.failed++;
+            }
+        }
+    });
+
+    // the filter stage runs here, in frame order
+    while (std::optional<Frame> frame = decoded.pop()) {
+        if (frame->decoded) {
+            TRACE_SCOPE("sequenceFilter");
+            auto stageStart = Clock::now();
+            FilterProgress progress;
+            filter.filter(frame->image, frame->index, pool, progress);
+            stats.filterSeconds += secondsSince(stageStart);
+        }
+        filtered.push(std::move(*frame));
+    }
+    filtered.close();
+    decoder.join();
+    encoder.join();
+
+    stats.seconds = secondsSince(start);
+    if (stats.frames > 1) {
+        double steady = std::chrono::duration<double>(lastWritten - *firstWritten).count();
+        stats.framesPerSecond = steady > 0.0 ? (stats.frames - 1) / steady : 0.0;
+    } else if (stats.seconds > 0.0) {
+        stats.framesPerSecond = stats.frames / stats.seconds;
+    }
+    return stats;
+}
@@ -0,0 +1,88 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <QString>
+#include <memory>
+#include "bufferpool.h"
+#include "filter.h"
+#include "settings.h"
+#include "stats.h"
+
+/**
+ * Frame sequence filtering.
+ *
+ * Frames are numbered files, named by a pattern whose run of '#' characters
+ * stands for the zero-padded frame number (frame_####.png is frame_0001.png,
+ * frame_0002.png, ...). The sequence ends at the first missing frame.
+ *
+ * Decoding, filtering and encoding run as a three stage pipeline, one thread
+ * per stage, with bounded queues of SEQUENCE_QUEUE_FRAMES frames between them:
+ * while frame n is filtered, frame n + 1 is being decoded and frame n - 1
+ * encoded, and a slow stage holds the others back instead of letting frames
+ * pile up in memory. The filter stage still spreads each frame over the pool.
+ */
+
+constexpr int SEQUENCE_QUEUE_FRAMES = 2;
+
+/**
+ * @class FrameFilter
+ *
+ * The filter stage of a sequence. Frames arrive strictly in order on a single
+ * thread, so a filter may carry state from one frame to the next.
+ */
+class FrameFilter {
+public:
+    virtual ~FrameFilter() = default;
+
+    // Filters frame number index in place; returns false if it was cancelled
+    virtual bool filter(Image &frame, int index, BufferPool &pool, FilterProgress &progress) = 0;
+};
+
+// Filters every frame on its own with params
+class StillFrameFilter : public FrameFilter {
+public:
+    explicit StillFrameFilter(const Settings &params) : m_params(params) {}
+    bool filter(Image &frame, int index, BufferPool &pool, FilterProgress &progress) override;
+
+private:
+    Settings m_params;
+};
+
+// Tone maps with levels that follow the frames' histograms gradually, so that
+// the brightness of the output does not flicker from frame to frame
+class ToneMapFrameFilter : public FrameFilter {
+public:
+    // Fraction of the way the levels move towards each new frame's
+    static constexpr float LEVELS_ADAPTATION = 0.2f;
+
+    explicit ToneMapFrameFilter(const Settings &params) : m_params(params) {}
+    bool filter(Image &frame, int index, BufferPool &pool, FilterProgress &progress) override;
+
+private:
+    Settings m_params;
+    ImageStats m_levels;
+    bool m_hasLevels = false;
+};
+
+// The frame filter for params: temporal where the filter type has one
+std::unique_ptr<FrameFilter> makeFrameFilter(const Settings &params);
+
+struct SequenceStats {
+    int frames = 0;                 // written successfully
+    int failed = 0;                 // could not be read or written
+    double seconds = 0.0;
+    double framesPerSecond = 0.0;   // sustained: between the first and last frame written
+    double decodeSeconds = 0.0;     // time each stage spent working
+    double filterSeconds = 0.0;
+    double encodeSeconds = 0.0;
+};
+
+// The file name of frame index under pattern
+QString frameFileName(const QString &pattern, int index);
+
+// Filters frames firstFrame, firstFrame + 1, ... of inputPattern with filter
+// and writes them under outputPattern
+SequenceStats runSequenceFilter(const QString &inputPattern, const QString &outputPattern, int firstFrame,
+                                FrameFilter &filter);
+
+#endif // SEQUENCE_H
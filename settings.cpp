@@ -14,6 +14,7 @@
 
 #include "settings.h"
 #include <QSettings>
+#include "convolve.h"
 
 Settings settings;
 
@@ -32,12 +33,22 @@ void Settings::loadSettingsOrDefaults() {
     brushColor.a = s.value("brushAlpha", 255).toInt();
     brushDensity = s.value("brushDensity", 5).toInt();
     fixAlphaBlending = s.value("fixAlphaBlending", false).toBool();
+    linearLight = s.value("linearLight", false).toBool();
 
     filterType = s.value("filterType", FILTER_EDGE_DETECT).toInt();
     edgeDetectSensitivity = s.value("edgeDetectSensitivity", 0.5f).toDouble();
     blurRadius = s.value("blurRadius", 10).toInt();
+    blurType = s.value("blurType", BLUR_GAUSSIAN).toInt();
+    blurAngle = s.value("blurAngle", 0.0).toFloat();
     scaleX = s.value("scaleX", 2).toDouble();
     scaleY = s.value("scaleY", 2).toDouble();
+    blurFixedPoint = s.value("blurFixedPoint", false).toBool();
+    edgeDetectFixedPoint = s.value("edgeDetectFixedPoint", false).toBool();
+    scaleFixedPoint = s.value("scaleFixedPoint", false).toBool();
+    blurBorderMode = s.value("blurBorderMode", BORDER_ZERO).toInt();
+    edgeDetectBorderMode = s.value("edgeDetectBorderMode", BORDER_ZERO).toInt();
+    scaleBorderMode = s.value("scaleBorderMode", BORDER_ZERO).toInt();
+    edgeDetectCanny = s.value("edgeDetectCanny", false).toBool();
     medianRadius = s.value("medianRadius", 1).toInt();
     rotationAngle = s.value("rotationAngle", 90.0).toFloat();
     bilateralRadius = s.value("bilateral radius", 1).toInt();
@@ -46,8 +57,10 @@ void Settings::loadSettingsOrDefaults() {
     bShift = s.value("bShift", 1).toInt();
     nonLinearMap = s.value("nonLinearMap", false).toBool();
     gamma = s.value("gamma", 0.1).toFloat();
+    filterPreview = s.value("filterPreview", false).toBool();
 
     imagePath = s.value("imagePath", "").toString();
+    brushStampPath = s.value("brushStampPath", "").toString();
 }
 
 /**
@@ -56,29 +69,48 @@ void Settings::loadSettingsOrDefaults() {
  */
 void Settings::saveSettings() {
     QSettings s("CS123", "CS123");
+    for (const SettingValue &setting : values()) {
+        s.setValue(setting.key, setting.value);
+    }
+}
 
-    s.setValue("brushType", brushType);
-    s.setValue("brushRadius", brushRadius);
-    s.setValue("brushRed", brushColor.r);
-    s.setValue("brushGreen", brushColor.g);
-    s.setValue("brushBlue", brushColor.b);
-    s.setValue("brushAlpha", brushColor.a);
-    s.setValue("brushDensity", brushDensity);
-    s.setValue("fixAlphaBlending", fixAlphaBlending);
+std::vector<SettingValue> Settings::values() const {
+    return {
+        {"brushType", brushType},
+        {"brushRadius", brushRadius},
+        {"brushRed", brushColor.r},
+        {"brushGreen", brushColor.g},
+        {"brushBlue", brushColor.b},
+        {"brushAlpha", brushColor.a},
+        {"brushDensity", brushDensity},
+        {"fixAlphaBlending", fixAlphaBlending},
+        {"linearLight", linearLight},
 
-    s.setValue("filterType", filterType);
-    s.setValue("edgeDetectSensitivity", edgeDetectSensitivity);
-    s.setValue("blurRadius", blurRadius);
-    s.setValue("scaleX", scaleX);
-    s.setValue("scaleY", scaleY);
-    s.setValue("medianRadius", medianRadius);
-    s.setValue("rotationAngle", rotationAngle);
-    s.setValue("bilateralRadius", bilateralRadius);
-    s.setValue("rShift", rShift);
-    s.setValue("gShift", gShift);
-    s.setValue("bShift", bShift);
-    s.setValue("nonLinearMap", nonLinearMap);
-    s.setValue("gamma", gamma);
+        {"filterType", filterType},
+        {"edgeDetectSensitivity", edgeDetectSensitivity},
+        {"blurRadius", blurRadius},
+        {"blurType", blurType},
+        {"blurAngle", blurAngle},
+        {"scaleX", scaleX},
+        {"scaleY", scaleY},
+        {"blurFixedPoint", blurFixedPoint},
+        {"edgeDetectFixedPoint", edgeDetectFixedPoint},
+        {"scaleFixedPoint", scaleFixedPoint},
+        {"blurBorderMode", blurBorderMode},
+        {"edgeDetectBorderMode", edgeDetectBorderMode},
+        {"scaleBorderMode", scaleBorderMode},
+        {"edgeDetectCanny", edgeDetectCanny},
+        {"medianRadius", medianRadius},
+        {"rotationAngle", rotationAngle},
+        {"bilateralRadius", bilateralRadius},
+        {"rShift", rShift},
+        {"gShift", gShift},
+        {"bShift", bShift},
+        {"nonLinearMap", nonLinearMap},
+        {"gamma", gamma},
+        {"filterPreview", filterPreview},
 
-    s.setValue("imagePath", imagePath);
+        {"imagePath", imagePath},
+        {"brushStampPath", brushStampPath},
+    };
 }
@@ -9,6 +9,8 @@
 #define SETTINGS_H
 
 #include <QObject>
+#include <QVariant>
+#include <vector>
 #include "rgba.h"
 
 // Enumeration values for the Brush types from which the user can choose in the GUI.
@@ -21,6 +23,7 @@ enum BrushType {
     BRUSH_SPEED,
     BRUSH_FILL,
     BRUSH_CUSTOM,
+    BRUSH_SELECT,       // drags out the rectangle filters are confined to; paints nothing
     NUM_BRUSH_TYPES
 };
 
@@ -37,6 +40,21 @@ enum FilterType {
     NUM_FILTER_TYPES
 };
 
+// Kernels the blur filter can use
+enum BlurType {
+    BLUR_GAUSSIAN,
+    BLUR_BOX,           // from a summed-area table, at the same cost for any radius
+    BLUR_TILT_SHIFT,    // box blur whose radius grows away from a sharp band across the middle
+    BLUR_MOTION,        // smears along a line of blurAngle, through convolve2D
+    NUM_BLUR_TYPES
+};
+
+// A persisted setting: its QSettings key and value
+struct SettingValue {
+    const char *key;
+    QVariant value;
+};
+
 /**
  * @struct Settings
  *
@@ -54,13 +72,23 @@ struct Settings {
     RGBA brushColor;
     int brushDensity; // This is for spray brush (extra credit)
     bool fixAlphaBlending; // Fix alpha blending (extra credit)
+    bool linearLight;      // Paint, blur and scale in linear light, see srgb.h
 
     // Filter
     int filterType;                     // The selected filter @see FilterType
     float edgeDetectSensitivity;    // Edge detection sensitivity, from 0 to 1.
     int blurRadius;                 // Selected blur radius
+    int blurType;                   // Blur kernel @see BlurType
+    float blurAngle;                // Motion blur direction in degrees, counter-clockwise from the x axis
     float scaleX;                   // Horizontal scale factor
     float scaleY;                   // Vertical scale factor
+    bool blurFixedPoint;            // Run blur passes on the integer path, see convolve.h
+    bool edgeDetectFixedPoint;      // Run edge detection passes on the integer path
+    bool scaleFixedPoint;           // Run scale passes on the integer path
+    int blurBorderMode;             // Edge handling of blur passes @see BorderMode
+    int edgeDetectBorderMode;       // Edge handling of edge detection passes @see BorderMode
+    int scaleBorderMode;            // Edge handling of scale passes @see BorderMode
+    bool edgeDetectCanny;           // Thin, connected Canny edges instead of the Sobel magnitude
     int medianRadius;               // Median radius (extra credit)
     float rotationAngle;            // Rotation angle (extra credit)
     int bilateralRadius;            // Bilateral radius (extra credit)
@@ -69,11 +97,16 @@ struct Settings {
     int bShift;                     // Chromatic aberration blue channel shift (extra credit)
     bool nonLinearMap;              // Use non-linear mapping function for tone mapping (extra credit)
     float gamma;                    // Gamma for tone mapping (extra credit)
+    bool filterPreview;             // Preview the filter at low resolution while its parameters change
 
     QString imagePath;
+    QString brushStampPath; // Image stamped by the custom brush
 
     void loadSettingsOrDefaults();
     void saveSettings();
+
+    // Every persisted field, in a fixed order
+    std::vector<SettingValue> values() const;
 };
 
 // The global Settings object, will be initialized by MainWindow
@@ -0,0 +1,95 @@
+#include "settingswriter.h"
+#include <QSettings>
+#include <algorithm>
+#include <cstring>
+#include "trace.h"
+
+SettingsWriter::SettingsWriter(const Settings &current)
+    : m_written(current.values()), m_current(m_written), m_debounce(std::make_unique<QTimer>()) {
+    m_debounce->setSingleShot(true);
+    m_debounce->setInterval(SETTINGS_SAVE_DELAY_MS);
+    QObject::connect(m_debounce.get(), &QTimer::timeout, [this] { submit(); });
+}
+
+SettingsWriter::~SettingsWriter() {
+    flush();
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+}
+
+void SettingsWriter::settingsChanged(const Settings &current) {
+    m_current = current.values();
+    m_debounce->start();
+}
+
+/**
+ * @brief Queues the fields that changed since the last hand-off for the writer
+ * thread, starting it the first time there is something to write
+ */
+void SettingsWriter::submit() {
+    std::vector<SettingValue> changed;
+    for (std::size_t i = 0; i < m_current.size(); i++) {
+        if (m_current[i].value != m_written[i].value) {
+            changed.push_back(m_current[i]);
+            m_written[i] = m_current[i];
+        }
+    }
+    if (changed.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // later values of a field still queued replace earlier ones
+        for (SettingValue &setting : changed) {
+            auto queued = std::find_if(m_queue.begin(), m_queue.end(),
+                                       [&](const SettingValue &other) { return std::strcmp(other.key, setting.key) == 0; });
+            if (queued != m_queue.end()) {
+                queued->value = std::move(setting.value);
+            } else {
+                m_queue.push_back(std::move(setting));
+            }
+        }
+    }
+    if (!m_thread.joinable()) {
+        m_thread = std::thread([this] { writeLoop(); });
+    }
+    m_wake.notify_one();
+}
+
+void SettingsWriter::flush() {
+    m_debounce->stop();
+    submit();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [&] { return m_queue.empty() && !m_writing; });
+}
+
+void SettingsWriter::writeLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [&] { return !m_queue.empty() || m_stopping; });
+        if (m_queue.empty()) {
+            return;
+        }
+        std::vector<SettingValue> batch;
+        batch.swap(m_queue);
+        m_writing = true;
+        lock.unlock();
+        {
+            TRACE_SCOPE("writeSettings");
+            QSettings s("CS123", "CS123");
+            for (const SettingValue &setting : batch) {
+                s.setValue(setting.key, setting.value);
+            }
+        }
+        lock.lock();
+        m_writing = false;
+        m_idle.notify_all();
+    }
+}
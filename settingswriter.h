@@ -0,0 +1,63 @@
+#ifndef SETTINGSWRITER_H
+#define SETTINGSWRITER_H
+
+#include <QTimer>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "settings.h"
+
+// How long the controls have to stay still before changed settings are written
+constexpr int SETTINGS_SAVE_DELAY_MS = 500;
+
+/**
+ * @class SettingsWriter
+ *
+ * Persists settings without blocking the GUI thread. Each change only
+ * records which fields now differ from what was last written, and restarts a
+ * SETTINGS_SAVE_DELAY_MS debounce window; once the window passes without
+ * further changes, just those fields are handed to a background thread that
+ * writes them to QSettings. Dragging a slider through a hundred values then
+ * costs one write of one field, off the interactive path. A field changed and
+ * changed back within the window is not written at all.
+ *
+ * Everything but the background write happens on the GUI thread. Pending
+ * writes are flushed when the writer is destroyed.
+ */
+class SettingsWriter {
+public:
+    // Takes current as what is already on disk
+    explicit SettingsWriter(const Settings &current);
+    ~SettingsWriter();
+
+    SettingsWriter(const SettingsWriter &) = delete;
+    SettingsWriter &operator=(const SettingsWriter &) = delete;
+
+    // Notes the fields of current that differ from the last write and
+    // schedules them to be written once the debounce window passes
+    void settingsChanged(const Settings &current);
+
+    // Writes whatever is pending right away and waits until it is written
+    void flush();
+
+private:
+    std::vector<SettingValue> m_written;    // as of the last hand-off to the writer thread
+    std::vector<SettingValue> m_current;    // as of the last settingsChanged()
+    std::unique_ptr<QTimer> m_debounce;
+
+    // Shared with the writer thread
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::vector<SettingValue> m_queue;
+    bool m_writing = false;
+    bool m_stopping = false;
+
+    void submit();
+    void writeLoop();
+};
+
+#endif // SETTINGSWRITER_H
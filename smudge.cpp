@@ -0,0 +1,119 @@
+#include "smudge.h"
+#include <algorithm>
+#include <cmath>
+#include "trace.h"
+
+// Distance between dabs along a drag, as a fraction of the brush radius
+constexpr float SMUDGE_SPACING = 0.25f;
+
+// Bilinearly samples a width x height grid at (x, y); taps that fall outside
+// the grid are transparent black
+static RGBA sampleBilinear(const RGBA *data, int width, int height, float x, float y) {
+    int x0 = static_cast<int>(std::floor(x));
+    int y0 = static_cast<int>(std::floor(y));
+    float fx = x - x0;
+    float fy = y - y0;
+    float weights[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+
+    float acc[4] = {0, 0, 0, 0};
+    for (int tap = 0; tap < 4; tap++) {
+        int tx = x0 + (tap & 1);
+        int ty = y0 + (tap >> 1);
+        if (weights[tap] == 0.0f || tx < 0 || tx >= width || ty < 0 || ty >= height) {
+            continue;
+        }
+        const RGBA &pixel = data[ty * width + tx];
+        acc[0] += weights[tap] * pixel.r;
+        acc[1] += weights[tap] * pixel.g;
+        acc[2] += weights[tap] * pixel.b;
+        acc[3] += weights[tap] * pixel.a;
+    }
+    return RGBA{static_cast<std::uint8_t>(acc[0] + 0.5f), static_cast<std::uint8_t>(acc[1] + 0.5f),
+                static_cast<std::uint8_t>(acc[2] + 0.5f), static_cast<std::uint8_t>(acc[3] + 0.5f)};
+}
+
+// Mixes paint over original by mask times the paint's alpha, keeping the original alpha
+static RGBA depositPaint(const RGBA &original, const RGBA &paint, float maskValue) {
+    float alphaMix = maskValue * (paint.a / 255.0f);
+    return RGBA{static_cast<std::uint8_t>(original.r * (1.0f - alphaMix) + paint.r * alphaMix + 0.5f),
+                static_cast<std::uint8_t>(original.g * (1.0f - alphaMix) + paint.g * alphaMix + 0.5f),
+                static_cast<std::uint8_t>(original.b * (1.0f - alphaMix) + paint.b * alphaMix + 0.5f),
+                original.a};
+}
+
+void SmudgeBrush::begin(const std::vector<RGBA> &canvas, int width, int height, float x, float y, int radius) {
+    m_radius = std::max(0, radius);
+    m_x = x;
+    m_y = y;
+
+    int size = 2 * m_radius + 1;
+    m_carried.resize(size * size);
+    m_pickup.resize(size * size);
+    for (int row = 0; row < size; row++) {
+        pickUpRow(canvas.data(), width, height, x, y, row, m_carried.data());
+    }
+}
+
+int SmudgeBrush::dragTo(std::vector<RGBA> &canvas, int width, int height, float x, float y) {
+    TRACE_SCOPE("smudgeDrag");
+    float dx = x - m_x;
+    float dy = y - m_y;
+    float spacing = std::max(1.0f, m_radius * SMUDGE_SPACING);
+    int dabs = std::max(1, static_cast<int>(std::ceil(std::sqrt(dx * dx + dy * dy) / spacing)));
+
+    for (int i = 1; i <= dabs; i++) {
+        float t = static_cast<float>(i) / dabs;
+        dab(canvas.data(), width, height, m_x + t * dx, m_y + t * dy);
+    }
+    m_x = x;
+    m_y = y;
+    return dabs;
+}
+
+/**
+ * @brief Deposits the carried stamp centered on (x, y) and picks up the result
+ * into m_pickup, then swaps the two
+ */
+void SmudgeBrush::dab(RGBA *canvas, int width, int height, float x, float y) {
+    int R = m_radius;
+    int size = 2 * R + 1;
+    int xBegin = std::max(0, static_cast<int>(std::ceil(x - R)));
+    int xEnd = std::min(width - 1, static_cast<int>(std::floor(x + R)));
+    int yBegin = std::max(0, static_cast<int>(std::ceil(y - R)));
+    int yEnd = std::min(height - 1, static_cast<int>(std::floor(y + R)));
+
+    int nextRow = 0;
+    for (int cy = yBegin; cy <= yEnd; cy++) {
+        float offsetY = cy - y;
+        RGBA *rowOut = canvas + cy * width;
+        for (int cx = xBegin; cx <= xEnd; cx++) {
+            float offsetX = cx - x;
+            float distance = std::sqrt(offsetX * offsetX + offsetY * offsetY);
+            if (distance > R) {
+                continue;
+            }
+            float maskValue = R > 0 ? 1.0f - distance / R : 1.0f;
+            RGBA paint = sampleBilinear(m_carried.data(), size, size, offsetX + R, offsetY + R);
+            rowOut[cx] = depositPaint(rowOut[cx], paint, maskValue);
+        }
+
+        // stamp rows that only sample canvas rows up to cy can be picked up now
+        while (nextRow < size && static_cast<int>(std::floor(y + nextRow - R)) + 1 <= cy) {
+            pickUpRow(canvas, width, height, x, y, nextRow++, m_pickup.data());
+        }
+    }
+    for (; nextRow < size; nextRow++) {
+        pickUpRow(canvas, width, height, x, y, nextRow, m_pickup.data());
+    }
+
+    m_carried.swap(m_pickup);
+}
+
+void SmudgeBrush::pickUpRow(const RGBA *canvas, int width, int height, float x, float y, int row, RGBA *stamp) const {
+    int size = 2 * m_radius + 1;
+    float sampleY = y + row - m_radius;
+    RGBA *rowOut = stamp + row * size;
+    for (int i = 0; i < size; i++) {
+        rowOut[i] = sampleBilinear(canvas, width, height, x + i - m_radius, sampleY);
+    }
+}
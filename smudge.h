@@ -0,0 +1,44 @@
+#ifndef SMUDGE_H
+#define SMUDGE_H
+
+#include <vector>
+#include "rgba.h"
+
+/**
+ * @class SmudgeBrush
+ *
+ * Carries a (2 * radius + 1)^2 stamp of paint along a stroke. Each dab
+ * deposits the carried paint under a linear falloff mask and picks up the
+ * result, in a single pass over the stamp rectangle: stamp rows are picked up
+ * one canvas row behind the deposit, as soon as every canvas row they sample
+ * is final.
+ *
+ * Drags are split into dabs spaced a fraction of the radius apart, so fast
+ * strokes with a large brush stay smooth. Dabs land at sub-pixel positions;
+ * pickup samples the canvas bilinearly and deposit samples the stamp
+ * bilinearly, with taps outside the canvas (or stamp) treated as transparent.
+ * At whole-pixel positions this is exactly the nearest-pixel smudge.
+ *
+ * The carried and freshly picked-up stamps live in two persistent buffers that
+ * swap roles after each dab, so smudging only allocates when the radius grows.
+ */
+class SmudgeBrush {
+public:
+    // Starts a stroke at (x, y), picking up the paint under the stamp
+    void begin(const std::vector<RGBA> &canvas, int width, int height, float x, float y, int radius);
+
+    // Drags the stamp from its last position to (x, y); returns the number of dabs
+    int dragTo(std::vector<RGBA> &canvas, int width, int height, float x, float y);
+
+private:
+    void dab(RGBA *canvas, int width, int height, float x, float y);
+    void pickUpRow(const RGBA *canvas, int width, int height, float x, float y, int row, RGBA *stamp) const;
+
+    int m_radius = 0;
+    float m_x = 0.0f;
+    float m_y = 0.0f;
+    std::vector<RGBA> m_carried;    // paint being deposited
+    std::vector<RGBA> m_pickup;     // paint picked up by the current dab
+};
+
+#endif // SMUDGE_H
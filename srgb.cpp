@@ -0,0 +1,200 @@
+#include "srgb.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+// The sRGB transfer functions on [0, 1]
+double decodeSrgb(double value) {
+    return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+double encodeSrgb(double value) {
+    return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+}
+
+SrgbTables buildTables() {
+    SrgbTables tables;
+    for (int v = 0; v < 256; v++) {
+        tables.decode[v] = static_cast<std::uint16_t>(std::lround(decodeSrgb(v / 255.0) * 65535.0));
+    }
+
+    // where round(255 * encodeSrgb(x)) steps up to v + 1, nudged onto the
+    // exact integer in case pow rounded the other way
+    auto encodesAbove = [](std::uint32_t linear, int v) {
+        return std::lround(255.0 * encodeSrgb(linear / 65535.0)) > v;
+    };
+    for (int v = 0; v < 255; v++) {
+        std::uint32_t threshold = static_cast<std::uint32_t>(std::ceil(decodeSrgb((v + 0.5) / 255.0) * 65535.0));
+        while (threshold > 0 && encodesAbove(threshold - 1, v)) {
+            threshold--;
+        }
+        while (!encodesAbove(threshold, v)) {
+            threshold++;
+        }
+        tables.thresholds[v] = threshold;
+    }
+    tables.thresholds[255] = 65536;
+
+    int value = 0;
+    for (std::uint32_t bucket = 0; bucket < tables.encode.size(); bucket++) {
+        std::uint32_t first = bucket << (16 - SRGB_ENCODE_BITS);
+        while (first >= tables.thresholds[value]) {
+            value++;
+        }
+        tables.encode[bucket] = static_cast<std::uint8_t>(value);
+    }
+    return tables;
+}
+
+inline std::uint16_t quantizeLinear(float x) {
+    return static_cast<std::uint16_t>(std::clamp(x, 0.0f, 65535.0f) + 0.5f);
+}
+
+// Kernels summing to about zero (e.g. derivatives) are never renormalized
+inline bool canRenormalize(float sum) {
+    return std::fabs(sum) > 1e-6f;
+}
+
+// acc[i] += weight * source[i] over [begin, end), in fixed blocks the compiler
+// turns into vector multiply-adds
+template <typename T>
+inline void accumulate(float *__restrict acc, const T *__restrict source, float weight, std::size_t begin,
+                       std::size_t end) {
+    constexpr std::size_t BLOCK = 16;
+    std::size_t i = begin;
+    for (; i + BLOCK <= end; i += BLOCK) {
+        for (std::size_t j = 0; j < BLOCK; j++) {
+            acc[i + j] += weight * source[i + j];
+        }
+    }
+    for (; i < end; i++) {
+        acc[i] += weight * source[i];
+    }
+}
+
+float kernelSum(const float *kernel, int radius) {
+    float sum = 0.0f;
+    for (int k = 0; k <= 2 * radius; k++) {
+        sum += kernel[k];
+    }
+    return sum;
+}
+
+} // namespace
+
+// Floats of a row accumulated through every tap before moving on, so that the
+// accumulator stays in L1 however wide the image and however many taps
+constexpr std::size_t LINEAR_CHUNK_FLOATS = 1024;
+
+const SrgbTables &srgbTables() {
+    static const SrgbTables tables = buildTables();
+    return tables;
+}
+
+/**
+ * @brief Each row is decoded once into a float line padded by radius pixels at
+ * either end, with the padding filled according to border. The taps are then
+ * accumulated one at a time across a chunk of the row (all four channels, so
+ * the loop is a plain multiply-add over contiguous floats), and the border
+ * columns rescaled afterwards under BORDER_ZERO_RENORMALIZED.
+ */
+void convolveRowsHorizontalLinear(const float *kernel, int radius, BorderMode border, const RGBA *input,
+                                  LinearPixel *output, int width, int, int rowBegin, int rowEnd) {
+    const SrgbTables &tables = srgbTables();
+    float sum = kernelSum(kernel, radius);
+    bool renormalize = border == BORDER_ZERO_RENORMALIZED && canRenormalize(sum);
+    thread_local std::vector<float> line;
+    thread_local std::vector<float> accumulator;
+    line.resize(4 * (std::size_t(width) + 2 * radius));
+    accumulator.resize(4 * std::size_t(width));
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        const RGBA *in = input + std::size_t(y) * width;
+        for (int x = -radius; x < width + radius; x++) {
+            int index = borderIndex(x, width, border);
+            float *padded = &line[4 * std::size_t(x + radius)];
+            if (index < 0) {
+                std::fill(padded, padded + 4, 0.0f);
+                continue;
+            }
+            padded[0] = srgbToLinear(tables, in[index].r);
+            padded[1] = srgbToLinear(tables, in[index].g);
+            padded[2] = srgbToLinear(tables, in[index].b);
+            padded[3] = 0.0f;
+        }
+
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+        for (std::size_t begin = 0; begin < accumulator.size(); begin += LINEAR_CHUNK_FLOATS) {
+            std::size_t end = std::min(begin + LINEAR_CHUNK_FLOATS, accumulator.size());
+            for (int k = 0; k <= 2 * radius; k++) {
+                accumulate(accumulator.data(), &line[4 * std::size_t(k)], kernel[k], begin, end);
+            }
+        }
+
+        LinearPixel *out = output + std::size_t(y) * width;
+        for (int x = 0; x < width; x++) {
+            float scale = 1.0f;
+            if (renormalize && (x < radius || x >= width - radius)) {
+                float usedWeight = 0.0f;
+                for (int k = -radius; k <= radius; k++) {
+                    if (x + k >= 0 && x + k < width) {
+                        usedWeight += kernel[k + radius];
+                    }
+                }
+                scale = canRenormalize(usedWeight) ? sum / usedWeight : 1.0f;
+            }
+            const float *acc = &accumulator[4 * std::size_t(x)];
+            out[x] = LinearPixel{quantizeLinear(acc[0] * scale), quantizeLinear(acc[1] * scale),
+                                 quantizeLinear(acc[2] * scale), 65535};
+        }
+    }
+}
+
+/**
+ * @brief The source row of each tap is resolved once per output row, then the
+ * rows are accumulated tap by tap as in the horizontal pass and encoded.
+ */
+void convolveRowsVerticalLinear(const float *kernel, int radius, BorderMode border, const LinearPixel *input,
+                                RGBA *output, int width, int height, int rowBegin, int rowEnd) {
+    const SrgbTables &tables = srgbTables();
+    float sum = kernelSum(kernel, radius);
+    thread_local std::vector<float> accumulator;
+    thread_local std::vector<std::pair<const std::uint16_t *, float>> taps;
+    accumulator.resize(4 * std::size_t(width));
+
+    for (int y = rowBegin; y < rowEnd; y++) {
+        taps.clear();
+        float usedWeight = 0.0f;
+        for (int k = -radius; k <= radius; k++) {
+            int sourceRow = borderIndex(y + k, height, border);
+            if (sourceRow >= 0) {
+                taps.emplace_back(reinterpret_cast<const std::uint16_t *>(input + std::size_t(sourceRow) * width),
+                                  kernel[k + radius]);
+                usedWeight += kernel[k + radius];
+            }
+        }
+
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+        for (std::size_t begin = 0; begin < accumulator.size(); begin += LINEAR_CHUNK_FLOATS) {
+            std::size_t end = std::min(begin + LINEAR_CHUNK_FLOATS, accumulator.size());
+            for (const auto &[source, weight] : taps) {
+                accumulate(accumulator.data(), source, weight, begin, end);
+            }
+        }
+
+        float scale = 1.0f;
+        if (border == BORDER_ZERO_RENORMALIZED && canRenormalize(sum) && canRenormalize(usedWeight)) {
+            scale = sum / usedWeight;
+        }
+
+        RGBA *out = output + std::size_t(y) * width;
+        for (int x = 0; x < width; x++) {
+            const float *acc = &accumulator[4 * std::size_t(x)];
+            out[x] = RGBA{linearToSrgb(tables, quantizeLinear(acc[0] * scale)),
+                          linearToSrgb(tables, quantizeLinear(acc[1] * scale)),
+                          linearToSrgb(tables, quantizeLinear(acc[2] * scale)), 255};
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef SRGB_H
+#define SRGB_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "convolve.h"
+#include "rgba.h"
+
+/**
+ * Linear-light processing.
+ *
+ * Canvas pixels are sRGB encoded: equal steps in value are roughly equal steps
+ * in perceived brightness, not in light. Averaging encoded values (blurring,
+ * resampling, painting translucent color) therefore darkens mixes of bright and
+ * dark; a blurred black and white edge gets a dark fringe, for example. In
+ * linear-light mode those operations decode r, g and b to linear light, average
+ * there and encode the result. Alpha is linear already and is left alone.
+ *
+ * Decoding is one lookup into a 256-entry table of 16-bit linear values (65535
+ * is full intensity). Encoding looks up the top SRGB_ENCODE_BITS bits of the
+ * linear value, which gives the answer or the value below it, and one compare
+ * against the next threshold picks between the two: the thresholds are at
+ * least 19 apart, so no bucket of 16 linear values holds more than one. The
+ * result is exactly round(255 * sRGB(linear / 65535)), and decoding then
+ * encoding gives back every value unchanged.
+ */
+
+constexpr int SRGB_ENCODE_BITS = 12;
+
+struct SrgbTables {
+    std::array<std::uint16_t, 256> decode;
+    // thresholds[v]: the smallest linear value that encodes above v
+    std::array<std::uint32_t, 256> thresholds;
+    // the encoded value of the first linear value in each bucket
+    std::array<std::uint8_t, 1 << SRGB_ENCODE_BITS> encode;
+};
+
+// Built on first use; hot loops should fetch the reference once
+const SrgbTables &srgbTables();
+
+inline std::uint16_t srgbToLinear(const SrgbTables &tables, std::uint8_t value) {
+    return tables.decode[value];
+}
+
+inline std::uint8_t linearToSrgb(const SrgbTables &tables, std::uint16_t value) {
+    std::uint8_t lower = tables.encode[value >> (16 - SRGB_ENCODE_BITS)];
+    return lower + (value >= tables.thresholds[lower]);
+}
+
+struct LinearPixel {
+    std::uint16_t r, g, b, a;
+};
+
+// An image in linear light at 16 bits per channel. Like GrayImage, the pixels
+// live in an RGBA vector (two entries per linear pixel), so linear planes are
+// recycled through the same BufferPool as color ones.
+struct LinearImage {
+    int width = 0;
+    int height = 0;
+    std::vector<RGBA> storage;
+
+    LinearPixel *data() { return reinterpret_cast<LinearPixel *>(storage.data()); }
+    const LinearPixel *data() const { return reinterpret_cast<const LinearPixel *>(storage.data()); }
+
+    static std::size_t storagePixels(int width, int height) { return std::size_t(width) * height * 2; }
+};
+
+// Row routines of the linear-light 1D passes, in the manner of convolve.h: the
+// horizontal pass decodes rows [rowBegin, rowEnd) of input and convolves them
+// into output, the vertical pass convolves them and encodes the result, with
+// alpha 255. Both accumulate in float; there is no fixed-point variant.
+void convolveRowsHorizontalLinear(const float *kernel, int radius, BorderMode border, const RGBA *input,
+                                  LinearPixel *output, int width, int height, int rowBegin, int rowEnd);
+void convolveRowsVerticalLinear(const float *kernel, int radius, BorderMode border, const LinearPixel *input,
+                                RGBA *output, int width, int height, int rowBegin, int rowEnd);
+
+#endif // SRGB_H
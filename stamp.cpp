@@ -0,0 +1,111 @@
+#include "stamp.h"
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+#include "trace.h"
+
+constexpr int STAMP_MASTER_SIZE = StampBrush::MASTER_SIZE;
+
+// Resamples srcLength samples spaced srcStride apart to dstLength samples, each
+// the average of the source interval it covers
+static void resampleLine(const float *src, int srcLength, int srcStride, float *dst, int dstLength, int dstStride) {
+    float scale = static_cast<float>(srcLength) / dstLength;
+    for (int i = 0; i < dstLength; i++) {
+        float begin = i * scale;
+        float end = std::min((i + 1) * scale, static_cast<float>(srcLength));
+        float sum = 0.0f;
+        for (int s = static_cast<int>(begin); s < end; s++) {
+            float overlap = std::min(end, s + 1.0f) - std::max(begin, static_cast<float>(s));
+            sum += overlap * src[s * srcStride];
+        }
+        dst[i * dstStride] = sum / scale;
+    }
+}
+
+// Separable area-average resampling of a single-channel image
+static std::vector<float> resampleArea(const std::vector<float> &src, int srcWidth, int srcHeight, int dstWidth, int dstHeight) {
+    std::vector<float> rows(dstWidth * srcHeight);
+    for (int y = 0; y < srcHeight; y++) {
+        resampleLine(&src[y * srcWidth], srcWidth, 1, &rows[y * dstWidth], dstWidth, 1);
+    }
+    std::vector<float> result(dstWidth * dstHeight);
+    for (int x = 0; x < dstWidth; x++) {
+        resampleLine(&rows[x], srcHeight, dstWidth, &result[x], dstHeight, dstWidth);
+    }
+    return result;
+}
+
+bool StampBrush::loadImage(const QString &file) {
+    TRACE_SCOPE("loadStamp");
+    QImage image;
+    if (!image.load(file) || image.width() == 0 || image.height() == 0) {
+        return false;
+    }
+    bool useAlpha = image.hasAlphaChannel();
+    image = image.convertToFormat(QImage::Format_RGBA8888);
+    int width = image.width();
+    int height = image.height();
+
+    std::vector<float> coverage(width * height);
+    for (int y = 0; y < height; y++) {
+        const std::uint8_t *row = image.constScanLine(y);
+        for (int x = 0; x < width; x++) {
+            const std::uint8_t *pixel = row + 4 * x;
+            float gray = 0.299f * pixel[0] + 0.587f * pixel[1] + 0.114f * pixel[2];
+            coverage[y * width + x] = useAlpha ? pixel[3] : 255.0f - gray;
+        }
+    }
+
+    // fit the image into the master square, centered, keeping its aspect ratio
+    float fit = static_cast<float>(STAMP_MASTER_SIZE) / std::max(width, height);
+    int fittedWidth = std::clamp(static_cast<int>(std::lround(width * fit)), 1, STAMP_MASTER_SIZE);
+    int fittedHeight = std::clamp(static_cast<int>(std::lround(height * fit)), 1, STAMP_MASTER_SIZE);
+    std::vector<float> fitted = resampleArea(coverage, width, height, fittedWidth, fittedHeight);
+
+    std::vector<float> master(STAMP_MASTER_SIZE * STAMP_MASTER_SIZE, 0.0f);
+    int left = (STAMP_MASTER_SIZE - fittedWidth) / 2;
+    int top = (STAMP_MASTER_SIZE - fittedHeight) / 2;
+    for (int y = 0; y < fittedHeight; y++) {
+        std::copy_n(&fitted[y * fittedWidth], fittedWidth, &master[(top + y) * STAMP_MASTER_SIZE + left]);
+    }
+
+    return loadMaster(master);
+}
+
+bool StampBrush::loadMaster(const std::vector<float> &master) {
+    if (master.size() != size_t(STAMP_MASTER_SIZE) * STAMP_MASTER_SIZE) {
+        return false;
+    }
+    m_master = master;
+    m_levels.clear();
+    m_offsets.clear();
+    for (int radius = 0; radius <= MAX_RADIUS; radius++) {
+        int size = 2 * radius + 1;
+        std::vector<float> level = resampleArea(master, STAMP_MASTER_SIZE, STAMP_MASTER_SIZE, size, size);
+        m_offsets.push_back(m_levels.size());
+        for (float value : level) {
+            m_levels.push_back(static_cast<std::uint8_t>(std::clamp(value, 0.0f, 255.0f) + 0.5f));
+        }
+    }
+    return true;
+}
+
+void StampBrush::makeDisk() {
+    m_master.clear();
+    m_levels.clear();
+    m_offsets.clear();
+    for (int radius = 0; radius <= MAX_RADIUS; radius++) {
+        m_offsets.push_back(m_levels.size());
+        for (int j = -radius; j <= radius; j++) {
+            for (int i = -radius; i <= radius; i++) {
+                float distance = std::sqrt(static_cast<float>(i * i + j * j));
+                float maskValue = radius > 0 ? 1.0f - distance / radius : 1.0f;
+                m_levels.push_back(distance <= radius ? static_cast<std::uint8_t>(maskValue * 255.0f + 0.5f) : 0);
+            }
+        }
+    }
+}
+
+const std::uint8_t *StampBrush::level(int radius) const {
+    return &m_levels[m_offsets[std::clamp(radius, 0, MAX_RADIUS)]];
+}
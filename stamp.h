@@ -0,0 +1,53 @@
+#ifndef STAMP_H
+#define STAMP_H
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class StampBrush
+ *
+ * A brush shape precomputed for every radius from 0 to MAX_RADIUS. Level r is
+ * a (2r + 1) x (2r + 1) 8-bit coverage stamp, so stamping at any radius (and
+ * switching radius mid-stroke, as the speed brush does) is a lookup, never a
+ * resample.
+ *
+ * Image stamps are fitted into a square master and every level is area
+ * averaged down from it, so small levels are properly prefiltered rather than
+ * point sampled. Images with alpha use it as coverage; opaque images use their
+ * darkness, so a black shape on white paints the shape.
+ */
+class StampBrush {
+public:
+    static constexpr int MAX_RADIUS = 100;
+    // Side of the square every image level is averaged down from
+    static constexpr int MASTER_SIZE = 2 * MAX_RADIUS + 1;
+
+    // Builds the levels from an image file; returns false if it cannot be read
+    bool loadImage(const QString &file);
+
+    // Builds the levels from a MASTER_SIZE x MASTER_SIZE coverage master, as
+    // kept by master(); returns false if it is not that size
+    bool loadMaster(const std::vector<float> &master);
+
+    // The master an image stamp was built from, so that it can be rebuilt
+    // exactly; empty for the disk
+    const std::vector<float> &master() const { return m_master; }
+
+    // Builds the levels as linear-falloff disks
+    void makeDisk();
+
+    bool empty() const { return m_levels.empty(); }
+
+    // The stamp for radius, which is clamped to [0, MAX_RADIUS]
+    const std::uint8_t *level(int radius) const;
+
+private:
+    std::vector<float> m_master;
+    std::vector<std::uint8_t> m_levels;     // every level back to back
+    std::vector<std::size_t> m_offsets;     // start of each level in m_levels
+};
+
+#endif // STAMP_H
@@ -0,0 +1,88 @@
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "filter.h"
+#include "threadpool.h"
+#include "trace.h"
+
+// Fewer pixels than this per chunk are not worth a sub-histogram of their own
+constexpr std::size_t STATS_MIN_CHUNK_PIXELS = 1 << 16;
+
+std::uint8_t ImageStats::percentile(int channel, float fraction) const {
+    std::uint64_t target = static_cast<std::uint64_t>(std::ceil(std::clamp(fraction, 0.0f, 1.0f) * pixels));
+    std::uint64_t seen = 0;
+    for (int value = 0; value < 256; value++) {
+        seen += histogram[channel][value];
+        if (seen >= std::max<std::uint64_t>(target, 1)) {
+            return static_cast<std::uint8_t>(value);
+        }
+    }
+    return 255;
+}
+
+ImageStats computeImageStats(const RGBA *data, std::size_t pixels) {
+    TRACE_SCOPE("computeImageStats");
+    ThreadPool &threads = ThreadPool::instance();
+    int chunks = static_cast<int>(std::clamp<std::size_t>(pixels / STATS_MIN_CHUNK_PIXELS, 1, threads.concurrency()));
+
+    // one set of histograms per chunk, so the counting needs no synchronization
+    using Histograms = std::array<std::array<std::uint32_t, 256>, NUM_STATS_CHANNELS>;
+    std::vector<Histograms> partial(chunks, Histograms{});
+    threads.parallelFor(0, chunks, [&](int chunk) {
+        Histograms &counts = partial[chunk];
+        std::size_t begin = pixels * chunk / chunks;
+        std::size_t end = pixels * (chunk + 1) / chunks;
+        for (std::size_t i = begin; i < end; i++) {
+            const RGBA &pixel = data[i];
+            counts[STATS_RED][pixel.r]++;
+            counts[STATS_GREEN][pixel.g]++;
+            counts[STATS_BLUE][pixel.b]++;
+            counts[STATS_LUMA][rgbaToGray(pixel)]++;
+        }
+    });
+
+    ImageStats stats;
+    for (const Histograms &counts : partial) {
+        for (int channel = 0; channel < NUM_STATS_CHANNELS; channel++) {
+            for (int value = 0; value < 256; value++) {
+                stats.histogram[channel][value] += counts[channel][value];
+            }
+        }
+    }
+    // the summaries only need the merged histograms
+    stats.summarize();
+    return stats;
+}
+
+void ImageStats::blendTowards(const ImageStats &other, float weight) {
+    for (int channel = 0; channel < NUM_STATS_CHANNELS; channel++) {
+        for (int value = 0; value < 256; value++) {
+            float blended = histogram[channel][value] + weight * (float(other.histogram[channel][value]) - histogram[channel][value]);
+            histogram[channel][value] = static_cast<std::uint32_t>(std::lround(blended));
+        }
+    }
+    summarize();
+}
+
+void ImageStats::summarize() {
+    pixels = 0;
+    for (std::uint32_t count : histogram[STATS_RED]) {
+        pixels += count;
+    }
+    for (int channel = 0; channel < NUM_STATS_CHANNELS; channel++) {
+        const auto &counts = histogram[channel];
+        auto first = std::find_if(counts.begin(), counts.end(), [](std::uint32_t n) { return n != 0; });
+        auto last = std::find_if(counts.rbegin(), counts.rend(), [](std::uint32_t n) { return n != 0; });
+        min[channel] = first == counts.end() ? 0 : static_cast<std::uint8_t>(first - counts.begin());
+        max[channel] = last == counts.rend() ? 0 : static_cast<std::uint8_t>(255 - (last - counts.rbegin()));
+
+        std::uint64_t sum = 0;
+        std::uint64_t total = 0;
+        for (int value = 0; value < 256; value++) {
+            sum += std::uint64_t(value) * counts[value];
+            total += counts[value];
+        }
+        mean[channel] = total == 0 ? 0.0f : static_cast<float>(double(sum) / total);
+    }
+}
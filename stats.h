@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "rgba.h"
+
+// Channels ImageStats keeps a histogram for
+enum StatsChannel {
+    STATS_RED,
+    STATS_GREEN,
+    STATS_BLUE,
+    STATS_LUMA,     // rgbaToGray() of each pixel
+    NUM_STATS_CHANNELS
+};
+
+/**
+ * @struct ImageStats
+ *
+ * Per-channel histograms of an image and the summaries derived from them.
+ * Everything is computed in one pass over the pixels, so consumers such as
+ * tone mapping and auto-levels can build their lookup tables from the
+ * histograms instead of scanning the image again.
+ */
+struct ImageStats {
+    std::uint64_t pixels = 0;
+    std::array<std::array<std::uint32_t, 256>, NUM_STATS_CHANNELS> histogram{};
+    std::array<std::uint8_t, NUM_STATS_CHANNELS> min{};
+    std::array<std::uint8_t, NUM_STATS_CHANNELS> max{};
+    std::array<float, NUM_STATS_CHANNELS> mean{};
+
+    // The smallest value v of channel such that at least fraction (in [0, 1])
+    // of the pixels are <= v
+    std::uint8_t percentile(int channel, float fraction) const;
+
+    // Moves the histograms weight (in [0, 1]) of the way towards other's, e.g.
+    // to follow the levels of a frame sequence without flicker
+    void blendTowards(const ImageStats &other, float weight);
+
+    // Recomputes pixels, min, max and mean from the histograms
+    void summarize();
+};
+
+// Histograms data[0, pixels) on the thread pool. Each thread fills its own
+// sub-histograms for a contiguous chunk, which are merged at the end.
+ImageStats computeImageStats(const RGBA *data, std::size_t pixels);
+
+#endif // STATS_H
@@ -0,0 +1,186 @@
+#include "strokes.h"
+#include <QDataStream>
+#include <QFile>
+#include <algorithm>
+#include "stamp.h"
+
+// "CSTR", then a format version
+constexpr quint32 STROKE_FILE_MAGIC = 0x43535452;
+constexpr quint16 STROKE_FILE_VERSION = 4;
+
+// Version 1 brush states have no linearLight flag
+constexpr quint16 STROKE_FILE_VERSION_NO_LINEAR = 1;
+
+// Versions up to 2 store positions in 16 bits, clamped
+constexpr quint16 STROKE_FILE_VERSION_SHORT_POSITIONS = 2;
+
+// Versions up to 3 do not store the custom brush's stamps
+constexpr quint16 STROKE_FILE_VERSION_NO_STAMPS = 3;
+
+BrushState brushState(const Settings &settings) {
+    return BrushState{settings.brushType, settings.brushRadius, settings.brushDensity, settings.brushColor,
+                      settings.fixAlphaBlending, settings.linearLight};
+}
+
+void applyBrushState(const BrushState &brush, Settings &settings) {
+    settings.brushType = brush.brushType;
+    settings.brushRadius = brush.brushRadius;
+    settings.brushDensity = brush.brushDensity;
+    settings.brushColor = brush.brushColor;
+    settings.fixAlphaBlending = brush.fixAlphaBlending;
+    settings.linearLight = brush.linearLight;
+}
+
+/**
+ * @brief Writes the header, then per event its type, position and the time
+ * since the previous event; mouse downs are followed by the brush state. The
+ * custom stamps come last, as single-precision coverage masters.
+ */
+bool StrokeRecording::save(const QString &file) const {
+    QFile out(file);
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&out);
+    stream << STROKE_FILE_MAGIC << STROKE_FILE_VERSION << qint32(width) << qint32(height) << quint32(seed)
+           << quint64(finalHash) << quint32(events.size());
+
+    std::int64_t previousUs = 0;
+    size_t brush = 0;
+    for (const StrokeEvent &event : events) {
+        quint32 deltaUs = static_cast<quint32>(std::clamp<std::int64_t>(event.timeUs - previousUs, 0, UINT32_MAX));
+        stream << quint8(event.type) << qint32(event.x) << qint32(event.y) << deltaUs;
+        previousUs = event.timeUs;
+
+        if (event.type == StrokeEvent::DOWN) {
+            const BrushState &state = brushes[brush++];
+            stream << quint8(state.brushType) << quint8(state.brushRadius) << quint8(state.brushDensity)
+                   << quint8(state.brushColor.r) << quint8(state.brushColor.g) << quint8(state.brushColor.b)
+                   << quint8(state.brushColor.a) << quint8(state.fixAlphaBlending) << quint8(state.linearLight)
+                   << qint32(state.stamp);
+        }
+    }
+
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << quint32(stamps.size());
+    for (const std::vector<float> &master : stamps) {
+        stream << quint32(master.size());
+        for (float value : master) {
+            stream << value;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool StrokeRecording::load(const QString &file) {
+    QFile in(file);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&in);
+    quint32 magic;
+    quint16 version;
+    qint32 fileWidth, fileHeight;
+    quint32 fileSeed, count;
+    quint64 fileHash;
+    stream >> magic >> version >> fileWidth >> fileHeight >> fileSeed >> fileHash >> count;
+    if (stream.status() != QDataStream::Ok || magic != STROKE_FILE_MAGIC ||
+        version < STROKE_FILE_VERSION_NO_LINEAR || version > STROKE_FILE_VERSION ||
+        fileWidth <= 0 || fileHeight <= 0) {
+        return false;
+    }
+    width = fileWidth;
+    height = fileHeight;
+    seed = fileSeed;
+    finalHash = fileHash;
+    events.clear();
+    brushes.clear();
+    stamps.clear();
+
+    std::int64_t timeUs = 0;
+    for (quint32 i = 0; i < count; i++) {
+        quint8 type;
+        qint32 x, y;
+        quint32 deltaUs;
+        stream >> type;
+        if (version <= STROKE_FILE_VERSION_SHORT_POSITIONS) {
+            qint16 shortX, shortY;
+            stream >> shortX >> shortY;
+            x = shortX;
+            y = shortY;
+        } else {
+            stream >> x >> y;
+        }
+        stream >> deltaUs;
+        if (stream.status() != QDataStream::Ok || type > StrokeEvent::UP) {
+            return false;
+        }
+        timeUs += deltaUs;
+        events.push_back(StrokeEvent{static_cast<StrokeEvent::Type>(type), x, y, timeUs});
+
+        if (type == StrokeEvent::DOWN) {
+            quint8 brushType, radius, density, r, g, b, a, fixAlpha;
+            quint8 linear = 0;
+            qint32 stamp = -1;
+            stream >> brushType >> radius >> density >> r >> g >> b >> a >> fixAlpha;
+            if (version != STROKE_FILE_VERSION_NO_LINEAR) {
+                stream >> linear;
+            }
+            if (version > STROKE_FILE_VERSION_NO_STAMPS) {
+                stream >> stamp;
+            }
+            brushes.push_back(BrushState{brushType, radius, density, RGBA{r, g, b, a}, fixAlpha != 0, linear != 0, stamp});
+        }
+    }
+
+    if (version > STROKE_FILE_VERSION_NO_STAMPS) {
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        quint32 stampCount;
+        stream >> stampCount;
+        for (quint32 i = 0; i < stampCount && stream.status() == QDataStream::Ok; i++) {
+            quint32 size;
+            stream >> size;
+            if (size != 0 && size != quint32(StampBrush::MASTER_SIZE * StampBrush::MASTER_SIZE)) {
+                return false;
+            }
+            std::vector<float> &master = stamps.emplace_back(size);
+            for (float &value : master) {
+                stream >> value;
+            }
+        }
+    }
+    for (BrushState &brush : brushes) {
+        if (brush.stamp >= static_cast<int>(stamps.size())) {
+            return false;
+        }
+        // the custom brush painted with whatever stamp the recording machine
+        // had, so the result cannot be checked
+        if (brush.brushType == BRUSH_CUSTOM && brush.stamp < 0) {
+            finalHash = 0;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+void summarizeLatencies(std::vector<double> &latenciesUs, ReplayStats &stats) {
+    if (latenciesUs.empty()) {
+        return;
+    }
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    auto percentile = [&](double q) {
+        return latenciesUs[static_cast<size_t>(q * (latenciesUs.size() - 1) + 0.5)];
+    };
+    stats.p50Us = percentile(0.50);
+    stats.p90Us = percentile(0.90);
+    stats.p99Us = percentile(0.99);
+    stats.maxUs = latenciesUs.back();
+}
+
+std::uint64_t canvasHash(const std::vector<RGBA> &data) {
+    std::uint64_t hash = 14695981039346656037ull;
+    const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(data.data());
+    for (size_t i = 0; i < data.size() * sizeof(RGBA); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,77 @@
+#ifndef STROKES_H
+#define STROKES_H
+
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include "rgba.h"
+#include "settings.h"
+
+/**
+ * Stroke recording and replay, for benchmarking brushes without a mouse.
+ *
+ * A recording holds the mouse events the canvas acted on, timestamped, plus
+ * the brush settings in effect at each mouse down. Replaying feeds the same
+ * events through the canvas's mouse handlers on a blank canvas without
+ * rendering. The spray brush draws from a seeded generator, and the custom
+ * brush's stamps are stored with the strokes, so a replay is fully
+ * deterministic and its final canvas hash can be checked.
+ */
+
+struct StrokeEvent {
+    enum Type : std::uint8_t { DOWN, DRAG, UP };
+
+    Type type;
+    std::int32_t x;
+    std::int32_t y;
+    std::int64_t timeUs;    // since the recording started
+};
+
+// The settings the brushes read
+struct BrushState {
+    int brushType = 0;
+    int brushRadius = 0;
+    int brushDensity = 0;
+    RGBA brushColor;
+    bool fixAlphaBlending = false;
+    bool linearLight = false;
+    int stamp = -1;     // the custom brush's stamp in the recording's stamps, or -1 if not recorded
+};
+
+BrushState brushState(const Settings &settings);
+void applyBrushState(const BrushState &brush, Settings &settings);
+
+struct StrokeRecording {
+    int width = 0;
+    int height = 0;
+    std::uint32_t seed = 0;         // spray generator seed at the start
+    std::uint64_t finalHash = 0;    // canvas hash at the end, or 0 if it depends on more than the strokes
+    std::vector<StrokeEvent> events;
+    std::vector<BrushState> brushes;    // one per DOWN event
+    // StampBrush::master() of each custom stamp the brushes use; empty for the disk
+    std::vector<std::vector<float>> stamps;
+
+    // Compact binary format: about 13 bytes per event
+    bool save(const QString &file) const;
+    bool load(const QString &file);
+};
+
+struct ReplayStats {
+    int events = 0;
+    std::uint64_t stamps = 0;       // brush dabs, smudge dabs, spray bursts and fills
+    double seconds = 0.0;
+    double stampsPerSecond = 0.0;
+    double p50Us = 0.0;             // per-event handler latency percentiles
+    double p90Us = 0.0;
+    double p99Us = 0.0;
+    double maxUs = 0.0;
+    std::uint64_t hash = 0;         // of the final canvas
+};
+
+// Fills in the latency fields of stats from per-event latencies (unsorted)
+void summarizeLatencies(std::vector<double> &latenciesUs, ReplayStats &stats);
+
+// 64-bit FNV-1a over the canvas pixels
+std::uint64_t canvasHash(const std::vector<RGBA> &data);
+
+#endif // STROKES_H
@@ -0,0 +1,287 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+// The pool and deque index of the worker running on this thread, if any
+static thread_local const ThreadPool *t_pool = nullptr;
+static thread_local int t_workerIndex = -1;
+
+static std::int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadPool::ThreadPool(int threadCount) {
+    for (int i = 0; i < threadCount; i++) {
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        m_workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread &worker : m_workers) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Returns the shared pool, sized to leave one hardware thread for the
+ * caller (usually the GUI or a filter job thread)
+ */
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    return pool;
+}
+
+int ThreadPool::currentWorker() const {
+    return t_pool == this ? t_workerIndex : -1;
+}
+
+/**
+ * TASK RINGS
+ */
+
+void ThreadPool::TaskRing::pushBack(Task &&task) {
+    m_slots[(m_head + m_size) % TASK_RING_CAPACITY] = std::move(task);
+    m_size++;
+}
+
+ThreadPool::Task ThreadPool::TaskRing::popBack() {
+    m_size--;
+    return std::exchange(m_slots[(m_head + m_size) % TASK_RING_CAPACITY], Task{});
+}
+
+ThreadPool::Task ThreadPool::TaskRing::popFront() {
+    Task task = std::exchange(m_slots[m_head], Task{});
+    m_head = (m_head + 1) % TASK_RING_CAPACITY;
+    m_size--;
+    return task;
+}
+
+int ThreadPool::TaskRing::revoke(const Batch *batch) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < m_size; i++) {
+        Task &task = m_slots[(m_head + i) % TASK_RING_CAPACITY];
+        if (task.batch == batch) {
+            task = Task{};
+        } else {
+            if (kept != i) {
+                m_slots[(m_head + kept) % TASK_RING_CAPACITY] = std::exchange(task, Task{});
+            }
+            kept++;
+        }
+    }
+    int revoked = static_cast<int>(m_size - kept);
+    m_size = kept;
+    return revoked;
+}
+
+/**
+ * SCHEDULING
+ */
+
+// The state of one parallelFor, on the caller's stack. Helpers claim indices
+// dynamically, so helpers that start late simply find nothing left to do.
+struct ThreadPool::Batch {
+    Batch(FunctionRef<void(int)> body, int begin, int end) : body(body), end(end), next(begin) {}
+
+    FunctionRef<void(int)> body;
+    int end;
+    std::atomic<int> next;
+    std::mutex mutex;
+    std::condition_variable done;
+    int helpersFinished = 0;        // under mutex
+};
+
+void ThreadPool::submit(std::function<void()> task) {
+    int index = currentWorker();
+    bool queued = false;
+    if (index >= 0) {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        if (!m_queues[index]->tasks.full()) {
+            m_queues[index]->tasks.pushBack(Task{std::move(task)});
+            queued = true;
+        }
+    }
+    {
+        // m_pending only goes up under m_mutex, so a worker about to sleep
+        // cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!queued) {
+            if (m_tasks.full()) {
+                m_overflow.push_back(Task{std::move(task)});
+            } else {
+                m_tasks.pushBack(Task{std::move(task)});
+            }
+        }
+        m_pending++;
+    }
+    m_wake.notify_one();
+}
+
+// Queues a helper for batch where submit() would put a task from worker;
+// returns false, queueing nothing, if that ring is full
+bool ThreadPool::submitHelper(Batch &batch, int worker) {
+    if (worker >= 0) {
+        std::lock_guard<std::mutex> lock(m_queues[worker]->mutex);
+        if (m_queues[worker]->tasks.full()) {
+            return false;
+        }
+        m_queues[worker]->tasks.pushBack(Task{{}, &batch});
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (worker < 0) {
+            if (m_tasks.full()) {
+                return false;
+            }
+            m_tasks.pushBack(Task{{}, &batch});
+        }
+        m_pending++;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+// Takes back the helpers of batch that no worker has picked up yet
+int ThreadPool::revokeHelpers(const Batch &batch, int worker) {
+    std::lock_guard<std::mutex> lock(worker >= 0 ? m_queues[worker]->mutex : m_mutex);
+    TaskRing &ring = worker >= 0 ? m_queues[worker]->tasks : m_tasks;
+    int revoked = ring.revoke(&batch);
+    m_pending -= revoked;
+    return revoked;
+}
+
+/**
+ * @brief Finds the next task for worker index: the newest task on its own deque,
+ * else the oldest task submitted from outside, else the oldest task on another
+ * worker's deque
+ */
+bool ThreadPool::takeTask(int index, Task &task) {
+    {
+        WorkerQueue &own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.popBack();
+            m_pending--;
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_tasks.empty()) {
+            task = m_tasks.popFront();
+            m_pending--;
+            return true;
+        }
+        if (!m_overflow.empty()) {
+            task = std::move(m_overflow.front());
+            m_overflow.pop_front();
+            m_pending--;
+            return true;
+        }
+    }
+    int count = static_cast<int>(m_queues.size());
+    for (int offset = 1; offset < count; offset++) {
+        WorkerQueue &victim = *m_queues[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.popFront();
+            m_pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::drain(Batch &batch) {
+    int i;
+    while ((i = batch.next.fetch_add(1)) < batch.end) {
+        batch.body(i);
+    }
+}
+
+// A helper touches its batch for the last time under the batch's mutex, which
+// the caller takes before it can return and destroy the batch
+void ThreadPool::runTask(Task &task) {
+    if (!task.batch) {
+        task.function();
+        return;
+    }
+    Batch &batch = *task.batch;
+    drain(batch);
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    batch.helpersFinished++;
+    batch.done.notify_all();
+}
+
+void ThreadPool::workerLoop(int index) {
+    t_pool = this;
+    t_workerIndex = index;
+
+    while (true) {
+        Task task;
+        if (takeTask(index, task)) {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping && m_pending == 0) {
+            return;
+        }
+        if (m_pending > 0) {
+            // another worker is mid-take; look again
+            continue;
+        }
+        std::int64_t idleStart = steadyNowNs();
+        m_wake.wait(lock, [this] { return m_stopping || m_pending > 0; });
+        m_idleNs.fetch_add(steadyNowNs() - idleStart, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Queues up to one helper per other thread and drains the range
+ * alongside them. Once every index is claimed, helpers still queued are taken
+ * back, and the call waits only for those already running.
+ */
+void ThreadPool::parallelFor(int begin, int end, FunctionRef<void(int)> body) {
+    int count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1 || m_workers.empty()) {
+        for (int i = begin; i < end; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    Batch batch(body, begin, end);
+
+    int worker = currentWorker();
+    int helpers = std::min(count, concurrency()) - 1;
+    int submitted = 0;
+    while (submitted < helpers && submitHelper(batch, worker)) {
+        submitted++;
+    }
+    drain(batch);
+    int running = submitted - revokeHelpers(batch, worker);
+
+    // a worker blocked here is idle as far as utilization goes
+    bool onWorker = worker >= 0;
+    std::int64_t waitStart = onWorker ? steadyNowNs() : 0;
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&batch, running] { return batch.helpersFinished == running; });
+    if (onWorker) {
+        m_idleNs.fetch_add(steadyNowNs() - waitStart, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class FunctionRef
+ *
+ * A non-owning reference to a callable, for parameters that are only called
+ * while the function they are passed to runs. Unlike std::function it never
+ * copies the callable, so passing a lambda never allocates.
+ */
+template <typename Signature>
+class FunctionRef;
+
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+public:
+    template <typename F>
+        requires(!std::is_same_v<std::remove_cvref_t<F>, FunctionRef> && std::is_invocable_r_v<R, F &, Args...>)
+    FunctionRef(F &&callable)
+        : m_callable(const_cast<void *>(static_cast<const void *>(std::addressof(callable)))),
+          m_call([](void *target, Args... args) -> R {
+              return std::invoke(*static_cast<std::remove_reference_t<F> *>(target), std::forward<Args>(args)...);
+          }) {}
+
+    R operator()(Args... args) const { return m_call(m_callable, std::forward<Args>(args)...); }
+
+private:
+    void *m_callable;
+    R (*m_call)(void *, Args...);
+};
+
+/**
+ * @class ThreadPool
+ *
+ * A fixed set of worker threads used by the filters to process image strips in
+ * parallel. Use ThreadPool::instance() to get the process-wide pool.
+ *
+ * Each worker owns a deque. Tasks submitted from a worker go on the back of its
+ * own deque and it pops them back first, so nested work (the strips of an image
+ * being filtered on that worker) stays on the core that has the image in cache.
+ * Idle workers steal from the front of other deques, taking the oldest and
+ * usually largest piece of work. Tasks submitted from outside the pool go on a
+ * shared queue.
+ *
+ * The deques are fixed rings of task slots, so queueing work allocates nothing
+ * and a parallelFor, whose state lives on the caller's stack, makes no heap
+ * allocation at all. Only submit() spills into a growable queue, once the ring
+ * it would go on is full.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Calls body(i) for every i in [begin, end), spread across the workers.
+    // The calling thread works on the range too, so this is safe to call from
+    // inside a task. Returns once every index has been processed.
+    void parallelFor(int begin, int end, FunctionRef<void(int)> body);
+
+    // Queues a fire-and-forget task
+    void submit(std::function<void()> task);
+
+    // Number of threads that can work on a parallelFor, including the caller
+    int concurrency() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // Number of worker threads, not counting callers
+    int workerCount() const { return static_cast<int>(m_workers.size()); }
+
+    // Total time workers have spent with nothing to run, either waiting for a
+    // task or waiting for other threads to finish a parallelFor they started.
+    // Sample it before and after a run to get the pool's utilization.
+    std::int64_t idleNs() const { return m_idleNs.load(std::memory_order_relaxed); }
+
+    static ThreadPool &instance();
+
+private:
+    // Task slots per ring; a parallelFor queues at most one helper per worker
+    static constexpr std::size_t TASK_RING_CAPACITY = 64;
+
+    struct Batch;
+
+    // A submitted function, or a helper draining the indices of a parallelFor
+    struct Task {
+        std::function<void()> function;
+        Batch *batch = nullptr;
+    };
+
+    // Fixed-capacity double-ended queue of tasks
+    class TaskRing {
+    public:
+        bool empty() const { return m_size == 0; }
+        bool full() const { return m_size == TASK_RING_CAPACITY; }
+
+        void pushBack(Task &&task);
+        Task popBack();
+        Task popFront();
+        // Removes the helpers of batch still queued; returns how many
+        int revoke(const Batch *batch);
+
+    private:
+        std::array<Task, TASK_RING_CAPACITY> m_slots;
+        std::size_t m_head = 0;
+        std::size_t m_size = 0;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        TaskRing tasks;
+    };
+
+    void workerLoop(int index);
+    bool takeTask(int index, Task &task);
+    void runTask(Task &task);
+    void drain(Batch &batch);
+    bool submitHelper(Batch &batch, int worker);
+    int revokeHelpers(const Batch &batch, int worker);
+    int currentWorker() const;
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    TaskRing m_tasks;                           // submitted from outside the pool
+    std::deque<Task> m_overflow;                // submitted once their ring was full
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_pending = 0;             // queued tasks across all queues
+    std::atomic<std::int64_t> m_idleNs = 0;
+    bool m_stopping = false;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,273 @@
+#include "trace.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <vector>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+Tracer tracer;
+
+namespace {
+
+#ifndef CANVAS_NO_TRACING
+// Incremented by the replacement operator new below. A plain thread_local
+// integer, so counting costs one increment even when tracing is disabled.
+thread_local std::uint64_t t_allocations = 0;
+#endif
+
+// Spans are appended to a buffer owned by the recording thread so that hot
+// paths never contend with each other; the mutex is only ever contended while
+// an export is running.
+struct ThreadBuffer {
+    std::uint32_t threadId;
+    std::mutex mutex;
+    std::vector<Tracer::Event> events;
+};
+
+std::mutex g_buffersMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+
+ThreadBuffer &localBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto created = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        created->threadId = static_cast<std::uint32_t>(g_buffers.size() + 1);
+        created->events.reserve(4096);
+        g_buffers.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+std::vector<Tracer::Event> snapshotEvents() {
+    std::vector<Tracer::Event> events;
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    for (auto &buffer : g_buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        events.insert(events.end(), buffer->events.begin(), buffer->events.end());
+    }
+    std::sort(events.begin(), events.end(), [](const Tracer::Event &a, const Tracer::Event &b) {
+        return a.startNs < b.startNs;
+    });
+    return events;
+}
+
+std::string escapeJson(const char *text) {
+    std::string escaped;
+    for (const char *c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') escaped += '\\';
+        escaped += *c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+/**
+ * ALLOCATION COUNTING
+ *
+ * Replacing the global operator new is the only portable way to observe heap
+ * allocations made by std containers and Qt. Sized and array forms forward to
+ * these by default; the aligned ones (cached kernels, for instance) are
+ * replaced too. Builds without tracing keep the standard allocator.
+ */
+#ifndef CANVAS_NO_TRACING
+namespace {
+
+// Tries allocate until it succeeds, calling the new-handler after every
+// failure as the standard operator new does, and throws once there is none
+template <typename Allocate>
+void *allocateOrThrow(Allocate allocate) {
+    t_allocations++;
+    while (true) {
+        if (void *ptr = allocate()) {
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    return allocateOrThrow([size] { return std::malloc(size ? size : 1); });
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    std::size_t align = static_cast<std::size_t>(alignment);
+    return allocateOrThrow([size, align] {
+#ifdef _MSC_VER
+        return _aligned_malloc(size ? size : 1, align);
+#else
+        // aligned_alloc wants a size that is a multiple of the alignment
+        return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+    });
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+std::uint64_t Tracer::threadAllocations() {
+    return t_allocations;
+}
+#else
+std::uint64_t Tracer::threadAllocations() {
+    return 0;
+}
+#endif
+
+/**
+ * TRACER
+ */
+
+void Tracer::setEnabled(bool enabled) {
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::initFromEnvironment() {
+    const char *path = std::getenv("CANVAS_TRACE");
+    if (path == nullptr || *path == '\0') {
+        return;
+    }
+    m_outputPath = path;
+    setEnabled(true);
+}
+
+/**
+ * @brief Writes the trace file requested through CANVAS_TRACE, if any, and prints
+ * the per-span summary
+ */
+void Tracer::shutdown() {
+    if (m_outputPath.empty()) {
+        return;
+    }
+    setEnabled(false);
+    if (writeChromeTrace(m_outputPath)) {
+        std::cout<<"Wrote trace to "<<m_outputPath<<std::endl;
+    }
+    std::cout<<summary();
+}
+
+std::int64_t Tracer::nowNs() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void Tracer::record(const Event &event) {
+    ThreadBuffer &buffer = localBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(event);
+    buffer.events.back().threadId = buffer.threadId;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    for (auto &buffer : g_buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->events.clear();
+    }
+}
+
+/**
+ * @brief Exports every recorded span as complete ("X") events in the Chrome
+ * trace_event format. Timestamps are in microseconds.
+ * @return True if the file was written, False otherwise.
+ */
+bool Tracer::writeChromeTrace(const std::string &path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cout<<"Failed to write trace"<<std::endl;
+        return false;
+    }
+
+    std::vector<Event> events = snapshotEvents();
+    out<<std::fixed<<std::setprecision(3);
+    out<<"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &e = events[i];
+        out<<"{\"name\":\""<<escapeJson(e.name)<<"\",\"cat\":\"canvas\",\"ph\":\"X\",\"pid\":1"
+           <<",\"tid\":"<<e.threadId
+           <<",\"ts\":"<<e.startNs / 1000.0
+           <<",\"dur\":"<<e.durationNs / 1000.0
+           <<",\"args\":{\"allocations\":"<<e.allocations<<"}}";
+        out<<(i + 1 < events.size() ? ",\n" : "\n");
+    }
+    out<<"]}\n";
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief Aggregates recorded spans by name
+ * @return A table of call count, total/mean/max time and allocations per span
+ */
+std::string Tracer::summary() {
+    struct Aggregate {
+        std::uint64_t count = 0;
+        std::int64_t totalNs = 0;
+        std::int64_t maxNs = 0;
+        std::uint64_t allocations = 0;
+    };
+
+    std::map<std::string, Aggregate> spans;
+    for (const Event &e : snapshotEvents()) {
+        Aggregate &agg = spans[e.name];
+        agg.count++;
+        agg.totalNs += e.durationNs;
+        agg.maxNs = std::max(agg.maxNs, e.durationNs);
+        agg.allocations += e.allocations;
+    }
+
+    std::ostringstream out;
+    out<<std::left<<std::setw(24)<<"span"<<std::right
+       <<std::setw(8)<<"count"<<std::setw(12)<<"total ms"<<std::setw(12)<<"mean ms"
+       <<std::setw(12)<<"max ms"<<std::setw(12)<<"allocs"<<"\n";
+    out<<std::fixed<<std::setprecision(3);
+    for (const auto &[name, agg] : spans) {
+        out<<std::left<<std::setw(24)<<name<<std::right
+           <<std::setw(8)<<agg.count
+           <<std::setw(12)<<agg.totalNs / 1e6
+           <<std::setw(12)<<agg.totalNs / 1e6 / agg.count
+           <<std::setw(12)<<agg.maxNs / 1e6
+           <<std::setw(12)<<agg.allocations<<"\n";
+    }
+    return out.str();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!m_active) {
+        return;
+    }
+    std::int64_t endNs = tracer.nowNs();
+    tracer.record(Tracer::Event{m_name, 0, m_startNs, endNs - m_startNs,
+                                Tracer::threadAllocations() - m_allocations});
+}
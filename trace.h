@@ -0,0 +1,94 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class Tracer
+ *
+ * Lightweight hot-path tracing. Wrap a region in TRACE_SCOPE("name") to record
+ * its wall time and the number of heap allocations made on the calling thread
+ * while it ran. Recording is off by default; a disabled span costs one relaxed
+ * atomic load. Spans are buffered per thread and can be exported as a Chrome
+ * `trace_event` JSON file (open it in chrome://tracing or ui.perfetto.dev) or
+ * summarized as a per-span table.
+ *
+ * You can access the tracer through the "tracer" global variable.
+ */
+class Tracer {
+public:
+    struct Event {
+        const char *name;           // must be a string literal (not copied)
+        std::uint32_t threadId;
+        std::int64_t startNs;       // relative to the tracer epoch
+        std::int64_t durationNs;
+        std::uint64_t allocations;
+    };
+
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled);
+
+    // Enables tracing if the CANVAS_TRACE environment variable is set; its value
+    // is the path the Chrome trace is written to on shutdown()
+    void initFromEnvironment();
+    void shutdown();
+
+    void record(const Event &event);
+    void clear();
+
+    bool writeChromeTrace(const std::string &path);
+    std::string summary();
+
+    std::int64_t nowNs() const;
+
+    // Number of operator new calls made on the calling thread so far; always 0
+    // in builds with CANVAS_NO_TRACING
+    static std::uint64_t threadAllocations();
+
+private:
+    std::atomic<bool> m_enabled = false;
+    std::string m_outputPath;
+    std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+};
+
+// The global Tracer object
+extern Tracer tracer;
+
+/**
+ * @brief RAII timing span; records an event into the tracer on destruction if
+ * tracing was enabled when it was constructed.
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) : m_name(name) {
+        if (tracer.enabled()) {
+            m_active = true;
+            m_allocations = Tracer::threadAllocations();
+            m_startNs = tracer.nowNs();
+        }
+    }
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *m_name;
+    bool m_active = false;
+    std::uint64_t m_allocations = 0;
+    std::int64_t m_startNs = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef CANVAS_NO_TRACING
+#define TRACE_SCOPE(name) ((void)0)
+#else
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#endif
+
+#endif // TRACE_H